@@ -37,6 +37,7 @@
 
 void (*agent_callback)(struct json_object *data, struct agent_data *request) = NULL;
 void (*agent_error_callback)(struct json_object *data) = NULL;
+void (*agent_registered_callback)(bool registered) = NULL;
 
 static DBusConnection *agent_connection;
 
@@ -396,6 +397,9 @@ static void agent_register_return(DBusMessageIter *iter,
 
 	} else
 		agent_request.registered = true;
+
+	if (agent_registered_callback)
+		agent_registered_callback(error == NULL);
 }
 
 int __connman_agent_register(DBusConnection *connection)
@@ -424,7 +428,7 @@ int __connman_agent_register(DBusConnection *connection)
 	append_path(&iter);
 
 	res = send_method_call(connection, msg, agent_register_return,
-			NULL);
+			connection);
 
 	if (res != -EINPROGRESS) {
 		__connman_agent_unregister(connection, NULL);
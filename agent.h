@@ -40,6 +40,8 @@ struct agent_data;
 
 extern void (*agent_callback)(struct json_object *data, struct agent_data *request);
 extern void (*agent_error_callback)(struct json_object *data);
+/* called when ConnMan answered RegisterAgent, if set */
+extern void (*agent_registered_callback)(bool registered);
 
 int __connman_agent_register(DBusConnection *connection);
 
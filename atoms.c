@@ -0,0 +1,442 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <json/json.h>
+
+#include "atoms.h"
+
+#define ATOMS_MIN_BUCKETS 256
+
+struct atom {
+	struct atom *next;
+	struct json_object *jstr;	// shared json string, built on demand
+	uint32_t hash;
+	uint32_t len;
+	uint32_t refs;			// __atom_ref minus __atom_unref
+	bool pinned;			// interned, kept until __atoms_terminate
+	char str[];
+};
+
+static struct atom **buckets;
+static unsigned int nb_buckets;
+static struct atoms_stats stats;
+
+/*
+ * The ui thread interns the short names while the dbus thread (see
+ * engine_thread_start) interns everything else.
+ */
+static pthread_mutex_t atoms_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define ATOM_OF(ptr) ((struct atom *) ((ptr) - offsetof(struct atom, str)))
+
+static uint32_t hash_string(const char *str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static void rehash(void)
+{
+	struct atom **new_buckets, *atom, *next;
+	unsigned int size = nb_buckets ? nb_buckets * 2 : ATOMS_MIN_BUCKETS, i;
+
+	new_buckets = calloc(size, sizeof(struct atom *));
+	assert(new_buckets != NULL);
+
+	for (i = 0; i < nb_buckets; i++) {
+		for (atom = buckets[i]; atom; atom = next) {
+			next = atom->next;
+			atom->next = new_buckets[atom->hash & (size - 1)];
+			new_buckets[atom->hash & (size - 1)] = atom;
+		}
+	}
+
+	stats.bytes += (size - nb_buckets) * sizeof(struct atom *);
+	free(buckets);
+	buckets = new_buckets;
+	nb_buckets = size;
+}
+
+static struct atom* find(const char *str, size_t len, uint32_t hash)
+{
+	struct atom *atom;
+
+	if (!nb_buckets)
+		return NULL;
+
+	for (atom = buckets[hash & (nb_buckets - 1)]; atom; atom = atom->next)
+		if (atom->hash == hash && atom->len == len &&
+				memcmp(atom->str, str, len) == 0)
+			return atom;
+
+	return NULL;
+}
+
+static const char* intern(const char *str, size_t len, bool counted)
+{
+	struct atom *atom;
+	uint32_t hash;
+
+	if (!str)
+		return NULL;
+
+	hash = hash_string(str, len);
+	pthread_mutex_lock(&atoms_lock);
+	stats.lookups++;
+
+	if ((atom = find(str, len, hash))) {
+		stats.hits++;
+		__atomic_fetch_add(&stats.bytes_saved, len + 1,
+				__ATOMIC_RELAXED);
+		goto found;
+	}
+
+	if (stats.atoms >= nb_buckets)
+		rehash();
+
+	atom = malloc(sizeof(struct atom) + len + 1);
+	assert(atom != NULL);
+	atom->jstr = NULL;
+	atom->hash = hash;
+	atom->len = len;
+	atom->refs = 0;
+	atom->pinned = false;
+	memcpy(atom->str, str, len);
+	atom->str[len] = '\0';
+
+	atom->next = buckets[hash & (nb_buckets - 1)];
+	buckets[hash & (nb_buckets - 1)] = atom;
+	stats.atoms++;
+	stats.bytes += sizeof(struct atom) + len + 1;
+
+found:
+	if (counted)
+		atom->refs++;
+	else
+		atom->pinned = true;
+
+	pthread_mutex_unlock(&atoms_lock);
+
+	return atom->str;
+}
+
+const char* __atom_intern_len(const char *str, size_t len)
+{
+	return intern(str, len, false);
+}
+
+const char* __atom_intern(const char *str)
+{
+	if (!str)
+		return NULL;
+
+	return intern(str, strlen(str), false);
+}
+
+/*
+ * Like __atom_intern but never allocates: NULL if str isn't an atom,
+ * which also means no atom (service path...) can be equal to it.
+ */
+const char* __atom_lookup(const char *str)
+{
+	struct atom *atom;
+	size_t len;
+
+	if (!str)
+		return NULL;
+
+	len = strlen(str);
+	pthread_mutex_lock(&atoms_lock);
+	atom = find(str, len, hash_string(str, len));
+	pthread_mutex_unlock(&atoms_lock);
+
+	return atom ? atom->str : NULL;
+}
+
+static const char* atom_vprintf(bool counted, const char *format,
+		va_list args)
+{
+	char buf[256], *tmp;
+	const char *res;
+	va_list copy;
+	int len;
+
+	va_copy(copy, args);
+	len = vsnprintf(buf, sizeof(buf), format, copy);
+	va_end(copy);
+
+	if (len < 0)
+		return NULL;
+
+	if ((size_t) len < sizeof(buf))
+		return intern(buf, len, counted);
+
+	tmp = malloc(len + 1);
+	assert(tmp != NULL);
+	vsnprintf(tmp, len + 1, format, args);
+
+	res = intern(tmp, len, counted);
+	free(tmp);
+
+	return res;
+}
+
+/*
+ * __atom_printf("/net/connman/technology/%s", name)
+ */
+const char* __atom_printf(const char *format, ...)
+{
+	const char *res;
+	va_list args;
+
+	va_start(args, format);
+	res = atom_vprintf(false, format, args);
+	va_end(args);
+
+	return res;
+}
+
+/*
+ * Counted atoms are for the strings that come and go with the services
+ * (paths, names...): the last __atom_unref frees them, unless the same
+ * string was also interned.
+ */
+const char* __atom_ref(const char *str)
+{
+	if (!str)
+		return NULL;
+
+	return intern(str, strlen(str), true);
+}
+
+/*
+ * __atom_ref_printf("/net/connman/service/%s", name)
+ */
+const char* __atom_ref_printf(const char *format, ...)
+{
+	const char *res;
+	va_list args;
+
+	va_start(args, format);
+	res = atom_vprintf(true, format, args);
+	va_end(args);
+
+	return res;
+}
+
+/*
+ * One more reference to an atom the caller already holds, without
+ * hashing it again.
+ */
+const char* __atom_dup(const char *atom)
+{
+	if (!atom)
+		return NULL;
+
+	pthread_mutex_lock(&atoms_lock);
+	ATOM_OF(atom)->refs++;
+	pthread_mutex_unlock(&atoms_lock);
+
+	return atom;
+}
+
+void __atom_unref(const char *atom)
+{
+	struct atom *entry, **prev;
+
+	if (!atom)
+		return;
+
+	entry = ATOM_OF(atom);
+	pthread_mutex_lock(&atoms_lock);
+	assert(entry->refs > 0);
+
+	if (--entry->refs > 0 || entry->pinned) {
+		pthread_mutex_unlock(&atoms_lock);
+		return;
+	}
+
+	for (prev = &buckets[entry->hash & (nb_buckets - 1)]; *prev != entry;
+			prev = &(*prev)->next)
+		;
+
+	*prev = entry->next;
+	stats.atoms--;
+	stats.bytes -= sizeof(struct atom) + entry->len + 1;
+	pthread_mutex_unlock(&atoms_lock);
+
+	json_object_put(entry->jstr);
+	free(entry);
+}
+
+uint32_t __atom_hash(const char *atom)
+{
+	return ATOM_OF(atom)->hash;
+}
+
+/*
+ * A json string of the atom, shared by everyone asking for it: don't
+ * modify it. The caller owns one reference.
+ */
+struct json_object* __atom_json(const char *atom)
+{
+	struct atom *entry;
+
+	if (!atom)
+		return NULL;
+
+	entry = ATOM_OF(atom);
+	pthread_mutex_lock(&atoms_lock);
+
+	if (entry->jstr)
+		__atomic_fetch_add(&stats.bytes_saved, entry->len + 1,
+				__ATOMIC_RELAXED);
+	else
+		entry->jstr = json_object_new_string(atom);
+
+	pthread_mutex_unlock(&atoms_lock);
+
+	return json_object_get(entry->jstr);
+}
+
+/*
+ * The shared json string of str if it's an atom (a known service
+ * path...), a new one otherwise: values are never made atoms, only
+ * matched against those the client already holds.
+ */
+struct json_object* __atom_json_lookup(const char *str)
+{
+	struct json_object *res = NULL;
+	struct atom *atom;
+	size_t len;
+
+	if (!str)
+		return NULL;
+
+	len = strlen(str);
+	pthread_mutex_lock(&atoms_lock);
+	stats.lookups++;
+
+	if ((atom = find(str, len, hash_string(str, len)))) {
+		stats.hits++;
+
+		if (atom->jstr)
+			__atomic_fetch_add(&stats.bytes_saved, len + 1,
+					__ATOMIC_RELAXED);
+		else
+			atom->jstr = json_object_new_string(atom->str);
+
+		res = json_object_get(atom->jstr);
+	}
+
+	pthread_mutex_unlock(&atoms_lock);
+
+	return res ? res : json_object_new_string(str);
+}
+
+/*
+ * json_object_object_add without copying the key when json-c allows it.
+ */
+void __atom_object_add(struct json_object *jobj, const char *atom,
+		struct json_object *val)
+{
+#ifdef JSON_C_OBJECT_KEY_IS_CONSTANT
+	__atomic_fetch_add(&stats.bytes_saved, ATOM_OF(atom)->len + 1,
+			__ATOMIC_RELAXED);
+	json_object_object_add_ex(jobj, atom, val,
+			JSON_C_OBJECT_KEY_IS_CONSTANT);
+#else
+	json_object_object_add(jobj, atom, val);
+#endif
+}
+
+void __atoms_stats(struct atoms_stats *res)
+{
+	pthread_mutex_lock(&atoms_lock);
+	*res = stats;
+	pthread_mutex_unlock(&atoms_lock);
+
+	// __atom_object_add counts without the lock
+	res->bytes_saved = __atomic_load_n(&stats.bytes_saved,
+			__ATOMIC_RELAXED);
+}
+
+/*
+ {
+	"atoms": 1234,
+	"bytes": 56789,
+	"lookups": 123456,
+	"hits": 122222,
+	"bytes_saved": 4567890
+ }
+ */
+struct json_object* __atoms_stats_json(void)
+{
+	struct json_object *res = json_object_new_object();
+	struct atoms_stats tmp;
+
+	__atoms_stats(&tmp);
+
+	json_object_object_add(res, "atoms", json_object_new_int64(tmp.atoms));
+	json_object_object_add(res, "bytes", json_object_new_int64(tmp.bytes));
+	json_object_object_add(res, "lookups",
+			json_object_new_int64(tmp.lookups));
+	json_object_object_add(res, "hits", json_object_new_int64(tmp.hits));
+	json_object_object_add(res, "bytes_saved",
+			json_object_new_int64(tmp.bytes_saved));
+
+	return res;
+}
+
+void __atoms_terminate(void)
+{
+	struct atom *atom, *next;
+	unsigned int i;
+
+	for (i = 0; i < nb_buckets; i++) {
+		for (atom = buckets[i]; atom; atom = next) {
+			next = atom->next;
+			json_object_put(atom->jstr);
+			free(atom);
+		}
+	}
+
+	free(buckets);
+	buckets = NULL;
+	nb_buckets = 0;
+	memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,87 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_ATOMS_H
+#define __CONNMAN_ATOMS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <json/json.h>
+
+/* longer strings aren't worth sharing when decoding dbus messages */
+#define ATOM_VALUE_MAX_LEN 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An atom is a string stored once for the whole program: two atoms are
+ * equal if and only if their pointers are equal.
+ *
+ * Interned atoms (__atom_intern, __atom_printf) are never freed before
+ * __atoms_terminate: they are for the strings there are few of, keys and
+ * enum values. The per-service ones (paths, names...) are counted with
+ * __atom_ref and freed by their last __atom_unref.
+ */
+
+struct atoms_stats {
+	unsigned long atoms;		// distinct strings stored
+	unsigned long bytes;		// memory used by the table
+	unsigned long lookups;
+	unsigned long hits;
+	unsigned long bytes_saved;	// string copies avoided
+};
+
+const char* __atom_intern(const char *str);
+
+const char* __atom_intern_len(const char *str, size_t len);
+
+const char* __atom_lookup(const char *str);
+
+const char* __atom_printf(const char *format, ...);
+
+const char* __atom_ref(const char *str);
+
+const char* __atom_ref_printf(const char *format, ...);
+
+const char* __atom_dup(const char *atom);
+
+void __atom_unref(const char *atom);
+
+uint32_t __atom_hash(const char *atom);
+
+struct json_object* __atom_json(const char *atom);
+
+struct json_object* __atom_json_lookup(const char *str);
+
+void __atom_object_add(struct json_object *jobj, const char *atom,
+		struct json_object *val);
+
+void __atoms_stats(struct atoms_stats *stats);
+
+struct json_object* __atoms_stats_json(void);
+
+void __atoms_terminate(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
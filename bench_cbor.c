@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <json/json.h>
+
+#include "cbor.h"
+
+/*
+ * Size, encoding and decoding time of a get_services reply in json text
+ * and in cbor (what the daemon sends to the clients of set_format).
+ */
+
+#define ITERATIONS 200
+
+static const int nb_services[] = { 10, 100, 500, 0 };
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct json_object* service_new(int i)
+{
+	char str[1024];
+
+	snprintf(str, sizeof(str), "[ \"/net/connman/service/"
+			"wifi_001122334455_%06d_managed_psk\", { "
+			"\"Type\": \"wifi\", \"Security\": [ \"psk\" ], "
+			"\"State\": \"idle\", \"Strength\": %d, "
+			"\"Favorite\": false, \"Immutable\": false, "
+			"\"AutoConnect\": false, \"Name\": \"network %d\", "
+			"\"Ethernet\": { \"Method\": \"auto\", "
+			"\"Interface\": \"wlan0\", "
+			"\"Address\": \"00:11:22:33:44:55\", \"MTU\": 1500 }, "
+			"\"IPv4\": { }, \"IPv4.Configuration\": { "
+			"\"Method\": \"dhcp\" }, \"IPv6\": { }, "
+			"\"IPv6.Configuration\": { \"Method\": \"auto\", "
+			"\"Privacy\": \"disabled\" }, \"Nameservers\": [ ], "
+			"\"Nameservers.Configuration\": [ ], "
+			"\"Timeservers\": [ ], \"Domains\": [ ], "
+			"\"Proxy\": { }, \"Provider\": { } } ]", i, i % 100, i);
+
+	return json_tokener_parse(str);
+}
+
+int main()
+{
+	struct cbor_buffer buf = { NULL, 0, 0 };
+	struct json_object *jservices, *jobj;
+	double start, json_enc, json_dec, cbor_enc, cbor_dec;
+	const char *str;
+	size_t json_len;
+	int i, j, nb;
+
+	for (i = 0; (nb = nb_services[i]); i++) {
+		jservices = json_object_new_array();
+
+		for (j = 0; j < nb; j++)
+			json_object_array_add(jservices, service_new(j));
+
+		start = now();
+
+		for (j = 0; j < ITERATIONS; j++)
+			str = json_object_to_json_string(jservices);
+
+		json_enc = (now() - start) * 1e6 / ITERATIONS;
+		json_len = strlen(str);
+		start = now();
+
+		for (j = 0; j < ITERATIONS; j++)
+			json_object_put(json_tokener_parse(str));
+
+		json_dec = (now() - start) * 1e6 / ITERATIONS;
+		start = now();
+
+		for (j = 0; j < ITERATIONS; j++) {
+			buf.len = 0;
+			__cbor_encode(&buf, jservices);
+		}
+
+		cbor_enc = (now() - start) * 1e6 / ITERATIONS;
+		start = now();
+
+		for (j = 0; j < ITERATIONS; j++)
+			json_object_put(__cbor_decode(buf.data, buf.len));
+
+		cbor_dec = (now() - start) * 1e6 / ITERATIONS;
+
+		jobj = __cbor_decode(buf.data, buf.len);
+
+		printf("[*] %3d services json: %7zu bytes, encode %6.0f us, "
+				"decode %6.0f us | cbor: %7zu bytes, "
+				"encode %6.0f us, decode %6.0f us %s\n", nb,
+				json_len, json_enc, json_dec, buf.len, cbor_enc,
+				cbor_dec, jobj && strcmp(str,
+					json_object_to_json_string(jobj)) == 0 ?
+				"" : "MISMATCH");
+
+		json_object_put(jobj);
+		json_object_put(jservices);
+	}
+
+	__cbor_buffer_free(&buf);
+
+	return 0;
+}
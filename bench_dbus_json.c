@@ -0,0 +1,352 @@
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dbus/dbus.h>
+#include <json/json.h>
+
+#include "dbus_json.h"
+
+/*
+ * Decoding time of the messages ConnMan sends the most, built like it
+ * does: the generic decoder (__connman_dbus_to_json) against the decoder
+ * picked for their signature (__connman_dbus_message_to_json).
+ *
+ * Then their json text: from the json objects (json_object_to_json_string)
+ * against written while the message is read (__connman_dbus_json_write),
+ * with the memory each needs at its peak.
+ */
+
+#define DECODED_ITEMS 200000
+
+void __connman_callback_ended(void)
+{
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append_variant(DBusMessageIter *iter, int type, const void *value)
+{
+	char signature[2] = { type, '\0' };
+	DBusMessageIter variant;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, signature,
+			&variant);
+	dbus_message_iter_append_basic(&variant, type, value);
+	dbus_message_iter_close_container(iter, &variant);
+}
+
+static void append_entry(DBusMessageIter *dict, const char *key, int type,
+		const void *value)
+{
+	DBusMessageIter entry;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	append_variant(&entry, type, value);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static void append_entry_dict(DBusMessageIter *dict, const char *key,
+		const char **strings, int nb)
+{
+	DBusMessageIter entry, variant, sub;
+	int i;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "a{sv}",
+			&variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "{sv}",
+			&sub);
+
+	for (i = 0; i < nb; i++)
+		append_entry(&sub, strings[2 * i], DBUS_TYPE_STRING,
+				&strings[2 * i + 1]);
+
+	dbus_message_iter_close_container(&variant, &sub);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static void append_entry_strings(DBusMessageIter *dict, const char *key,
+		const char **strings, int nb)
+{
+	DBusMessageIter entry, variant, array;
+	int i;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "as",
+			&variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "s",
+			&array);
+
+	for (i = 0; i < nb; i++)
+		dbus_message_iter_append_basic(&array, DBUS_TYPE_STRING,
+				&strings[i]);
+
+	dbus_message_iter_close_container(&variant, &array);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+// (oa{sv}), a wifi service
+static void append_service(DBusMessageIter *array, int i)
+{
+	const char *ipv4[] = { "Method", "dhcp", "Address", "192.168.1.10",
+		"Netmask", "255.255.255.0" };
+	const char *ethernet[] = { "Method", "auto", "Interface", "wlan0",
+		"Address", "00:11:22:33:44:55" };
+	const char *security[] = { "psk" };
+	const char *type = "wifi", *state = "idle", *str = "", *path, *name;
+	char path_buf[128], name_buf[64];
+	DBusMessageIter object, dict;
+	dbus_bool_t b = FALSE;
+	unsigned char strength = i % 100;
+
+	snprintf(path_buf, sizeof(path_buf), "/net/connman/service/"
+			"wifi_001122334455_%06d_managed_psk", i);
+	snprintf(name_buf, sizeof(name_buf), "network %d", i);
+	path = path_buf;
+	name = name_buf;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, NULL,
+			&object);
+	dbus_message_iter_append_basic(&object, DBUS_TYPE_OBJECT_PATH, &path);
+	dbus_message_iter_open_container(&object, DBUS_TYPE_ARRAY, "{sv}",
+			&dict);
+	append_entry(&dict, "Type", DBUS_TYPE_STRING, &type);
+	append_entry_strings(&dict, "Security", security, 1);
+	append_entry(&dict, "State", DBUS_TYPE_STRING, &state);
+	append_entry(&dict, "Strength", DBUS_TYPE_BYTE, &strength);
+	append_entry(&dict, "Favorite", DBUS_TYPE_BOOLEAN, &b);
+	append_entry(&dict, "Immutable", DBUS_TYPE_BOOLEAN, &b);
+	append_entry(&dict, "AutoConnect", DBUS_TYPE_BOOLEAN, &b);
+	append_entry(&dict, "Name", DBUS_TYPE_STRING, &name);
+	append_entry_dict(&dict, "Ethernet", ethernet, 3);
+	append_entry_dict(&dict, "IPv4", ipv4, 3);
+	append_entry_dict(&dict, "IPv6", NULL, 0);
+	append_entry_strings(&dict, "Nameservers", NULL, 0);
+	append_entry(&dict, "Provider.Host", DBUS_TYPE_STRING, &str);
+	dbus_message_iter_close_container(&object, &dict);
+	dbus_message_iter_close_container(array, &object);
+}
+
+static DBusMessage* get_services_new(int nb)
+{
+	DBusMessage *message = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+	DBusMessageIter iter, array;
+	int i;
+
+	dbus_message_iter_init_append(message, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(oa{sv})",
+			&array);
+
+	for (i = 0; i < nb; i++)
+		append_service(&array, i);
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return message;
+}
+
+static DBusMessage* services_changed_new(void)
+{
+	const char *removed = "/net/connman/service/"
+		"wifi_001122334455_000042_managed_psk";
+	DBusMessageIter iter, array;
+	DBusMessage *message;
+
+	message = dbus_message_new_signal("/", "net.connman.Manager",
+			"ServicesChanged");
+	dbus_message_iter_init_append(message, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(oa{sv})",
+			&array);
+	append_service(&array, 1);
+	dbus_message_iter_close_container(&iter, &array);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "o", &array);
+	dbus_message_iter_append_basic(&array, DBUS_TYPE_OBJECT_PATH, &removed);
+	dbus_message_iter_close_container(&iter, &array);
+
+	return message;
+}
+
+static DBusMessage* property_changed_new(const char *name, int type,
+		const void *value)
+{
+	DBusMessage *message;
+	DBusMessageIter iter;
+
+	message = dbus_message_new_signal("/net/connman/service/"
+			"wifi_001122334455_000001_managed_psk",
+			"net.connman.Service", "PropertyChanged");
+	dbus_message_iter_init_append(message, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &name);
+	append_variant(&iter, type, value);
+
+	return message;
+}
+
+static double decode_time(DBusMessage *message, int iterations,
+		bool generic)
+{
+	DBusMessageIter iter;
+	double start;
+	int i;
+
+	start = now();
+
+	for (i = 0; i < iterations; i++) {
+		if (generic) {
+			dbus_message_iter_init(message, &iter);
+			json_object_put(__connman_dbus_to_json(&iter));
+		} else
+			json_object_put(__connman_dbus_message_to_json(message));
+	}
+
+	return (now() - start) * 1e9 / iterations;
+}
+
+static double text_time(DBusMessage *message, int iterations,
+		bool streamed)
+{
+	struct dbus_json_writer writer;
+	struct json_object *jobj;
+	DBusMessageIter iter;
+	double start;
+	int i;
+
+	start = now();
+
+	for (i = 0; i < iterations; i++) {
+		dbus_message_iter_init(message, &iter);
+
+		if (streamed) {
+			__connman_dbus_json_writer_init(&writer, -1);
+			__connman_dbus_json_write(&writer, &iter);
+			__connman_dbus_json_writer_free(&writer);
+		} else {
+			jobj = __connman_dbus_to_json(&iter);
+			json_object_to_json_string(jobj);
+			json_object_put(jobj);
+		}
+	}
+
+	return (now() - start) * 1e9 / iterations;
+}
+
+// both texts hold the same json
+static bool same_text(const char *a, const char *b)
+{
+	struct json_object *ja = json_tokener_parse(a);
+	struct json_object *jb = json_tokener_parse(b);
+	bool same = ja && jb && strcmp(json_object_to_json_string(ja),
+			json_object_to_json_string(jb)) == 0;
+
+	json_object_put(ja);
+	json_object_put(jb);
+
+	return same;
+}
+
+static void bench_text(const char *name, DBusMessage *message, int items)
+{
+	int iterations = DECODED_ITEMS / items;
+	struct dbus_json_writer writer;
+	struct json_object *jobj;
+	size_t start, tree_peak;
+	double before, after;
+	DBusMessageIter iter;
+	const char *text;
+	bool same;
+
+	// the objects and their text are both in memory
+	start = mallinfo2().uordblks;
+	dbus_message_iter_init(message, &iter);
+	jobj = __connman_dbus_to_json(&iter);
+	text = json_object_to_json_string(jobj);
+	tree_peak = mallinfo2().uordblks - start;
+
+	dbus_message_iter_init(message, &iter);
+	__connman_dbus_json_writer_init(&writer, -1);
+	__connman_dbus_json_write(&writer, &iter);
+	same = same_text(text, writer.data);
+
+	before = text_time(message, iterations, false);
+	after = text_time(message, iterations, true);
+
+	printf("[*] %-28s json text: %9.0f ns %8zu B, streamed: %9.0f ns "
+			"%8zu B (text %zu B) %s\n", name, before, tree_peak,
+			after, writer.size, writer.len,
+			same ? "" : "MISMATCH");
+
+	json_object_put(jobj);
+	__connman_dbus_json_writer_free(&writer);
+}
+
+static void bench(const char *name, DBusMessage *message, int items)
+{
+	struct json_object *generic, *specialised;
+	int iterations = DECODED_ITEMS / items;
+	double before, after;
+	DBusMessageIter iter;
+	bool same;
+
+	dbus_message_iter_init(message, &iter);
+	generic = __connman_dbus_to_json(&iter);
+	specialised = __connman_dbus_message_to_json(message);
+	same = strcmp(json_object_to_json_string(generic),
+			json_object_to_json_string(specialised)) == 0;
+
+	// the atoms are interned by the first decodes
+	before = decode_time(message, iterations, true);
+	after = decode_time(message, iterations, false);
+
+	printf("[*] %-28s generic: %9.0f ns, specialised: %9.0f ns "
+			"(x%.2f) %s\n", name, before, after, before / after,
+			same ? "" : "MISMATCH");
+
+	bench_text(name, message, items);
+
+	json_object_put(generic);
+	json_object_put(specialised);
+	dbus_message_unref(message);
+}
+
+int main()
+{
+	unsigned char strength = 73;
+	const char *state = "ready";
+	const char *name = "caf\xc3\xa9 \"guest\"\\\t\x01";
+
+	bench("GetServices (10)", get_services_new(10), 10);
+	bench("GetServices (100)", get_services_new(100), 100);
+	bench("GetServices (1000)", get_services_new(1000), 1000);
+	bench("ServicesChanged", services_changed_new(), 1);
+	bench("PropertyChanged Strength", property_changed_new("Strength",
+				DBUS_TYPE_BYTE, &strength), 1);
+	bench("PropertyChanged State", property_changed_new("State",
+				DBUS_TYPE_STRING, &state), 1);
+	bench("PropertyChanged Name", property_changed_new("Name",
+				DBUS_TYPE_STRING, &name), 1);
+
+	return 0;
+}
@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <json/json.h>
+
+#include "engine.h"
+#include "loop.h"
+#include "server.h"
+
+/*
+ * Cost of a signal sent to 1, 10 and 100 subscribers of the daemon: the
+ * callback (serialization and queueing) and the writes of the loop,
+ * against serializing the signal once per subscriber.
+ */
+
+#define EVENTS 1000
+#define ROUNDS 10
+
+static const int subscribers[] = { 1, 10, 100, 0 };
+
+void __connman_callback_ended(void)
+{
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool quit(void *data)
+{
+	loop_quit();
+
+	return false;
+}
+
+// one loop iteration, at least
+static void run_loop(void)
+{
+	loop_add_timer(0, quit, NULL);
+	loop_run(false);
+}
+
+static struct json_object* signal_new(int i)
+{
+	char str[256];
+
+	snprintf(str, sizeof(str), "{ \"cmd_interface\": \"Service\", "
+			"\"cmd_path\": \"wifi_001122334455_%04d_managed_psk\", "
+			"\"cmd_data\": [ \"Strength\", %d ], "
+			"\"SIGNAL\": \"PropertyChanged\" }", i % 30, i % 100);
+
+	return json_tokener_parse(str);
+}
+
+static void drain(int *fds, int nb)
+{
+	char buf[65536];
+	int i;
+
+	for (i = 0; i < nb; i++)
+		while (recv(fds[i], buf, sizeof(buf), MSG_DONTWAIT) > 0)
+			;
+}
+
+static int connect_client(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+			write(fd, "{ \"command\": \"subscribe\" }\n", 27) != 27) {
+		perror("[-] connect");
+		exit(1);
+	}
+
+	return fd;
+}
+
+int main()
+{
+	struct json_object *jobj;
+	char path[64];
+	int fds[100], i, j, k, nb;
+	double start, callback, flush, serialize;
+
+	snprintf(path, sizeof(path), "/tmp/bench_fanout-%d.sock", getpid());
+	loop_init();
+
+	for (i = 0; (nb = subscribers[i]); i++) {
+		if (__server_start(path) < 0) {
+			printf("[-] can't listen on %s\n", path);
+			return 1;
+		}
+
+		// the server accepts them in its loop, within its backlog
+		for (j = 0; j < nb; j++) {
+			fds[j] = connect_client(path);
+
+			if (j % 8 == 7)
+				run_loop();
+		}
+
+		run_loop();
+		run_loop();
+		drain(fds, nb);
+		callback = flush = serialize = 0;
+
+		for (k = 0; k < ROUNDS; k++) {
+			for (j = 0; j < EVENTS; j++) {
+				jobj = signal_new(j);
+				start = now();
+				__server_callback(ENGINE_SIGNAL_STATUS, jobj);
+				callback += now() - start;
+			}
+
+			start = now();
+			run_loop();
+			flush += now() - start;
+			drain(fds, nb);
+		}
+
+		// what each subscriber serializing the signal would cost
+		jobj = signal_new(0);
+		start = now();
+
+		for (k = 0; k < ROUNDS * EVENTS; k++)
+			for (j = 0; j < nb; j++)
+				json_object_to_json_string(jobj);
+
+		serialize = now() - start;
+		json_object_put(jobj);
+
+		printf("[*] %3d subscribers callback: %6.0f ns/event "
+				"(%5.0f ns/subscriber), writes: %6.0f ns/event, "
+				"serialized per subscriber: %7.0f ns/event\n", nb,
+				callback * 1e9 / (ROUNDS * EVENTS),
+				callback * 1e9 / (ROUNDS * EVENTS) / nb,
+				flush * 1e9 / (ROUNDS * EVENTS),
+				serialize * 1e9 / (ROUNDS * EVENTS));
+
+		for (j = 0; j < nb; j++)
+			close(fds[j]);
+
+		__server_stop();
+	}
+
+	loop_destroy();
+
+	return 0;
+}
@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dbus/dbus.h>
+#include <json/json.h>
+
+#include "dbus_json.h"
+#include "service_table.h"
+
+/*
+ * Loading a GetServices reply of 1000 services in the service table: from
+ * its json (__connman_dbus_reply_to_json and __service_table_load, the
+ * way of a snapshot reconcile) against from the message, with the strings
+ * borrowed from it (__service_table_load_dbus), by 1, 2 and 4 threads.
+ * The allocations of the bench are counted by wrapping the ones of glibc.
+ *
+ * bench_services_load [number of services]
+ */
+
+#define LOADS 50
+
+static int services = 1000;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static bool counting;
+static unsigned long allocations;
+
+void *malloc(size_t size)
+{
+	if (counting)
+		__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (counting)
+		__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (counting)
+		__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+
+	return __libc_realloc(ptr, size);
+}
+
+void __connman_callback_ended(void)
+{
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append_variant(DBusMessageIter *iter, int type, const void *value)
+{
+	char signature[2] = { type, '\0' };
+	DBusMessageIter variant;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, signature,
+			&variant);
+	dbus_message_iter_append_basic(&variant, type, value);
+	dbus_message_iter_close_container(iter, &variant);
+}
+
+static void append_entry(DBusMessageIter *dict, const char *key, int type,
+		const void *value)
+{
+	DBusMessageIter entry;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	append_variant(&entry, type, value);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static void append_entry_dict(DBusMessageIter *dict, const char *key,
+		const char **strings, int nb)
+{
+	DBusMessageIter entry, variant, sub;
+	int i;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "a{sv}",
+			&variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "{sv}",
+			&sub);
+
+	for (i = 0; i < nb; i++)
+		append_entry(&sub, strings[2 * i], DBUS_TYPE_STRING,
+				&strings[2 * i + 1]);
+
+	dbus_message_iter_close_container(&variant, &sub);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static void append_entry_strings(DBusMessageIter *dict, const char *key,
+		const char **strings, int nb)
+{
+	DBusMessageIter entry, variant, array;
+	int i;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "as",
+			&variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "s",
+			&array);
+
+	for (i = 0; i < nb; i++)
+		dbus_message_iter_append_basic(&array, DBUS_TYPE_STRING,
+				&strings[i]);
+
+	dbus_message_iter_close_container(&variant, &array);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+// (oa{sv}), a wifi service
+static void append_service(DBusMessageIter *array, int i)
+{
+	const char *ipv4[] = { "Method", "dhcp", "Address", "192.168.1.10",
+		"Netmask", "255.255.255.0" };
+	const char *ethernet[] = { "Method", "auto", "Interface", "wlan0",
+		"Address", "00:11:22:33:44:55" };
+	const char *security[] = { "psk" };
+	const char *type = "wifi", *state = "idle", *str = "", *path, *name;
+	char path_buf[128], name_buf[64];
+	DBusMessageIter object, dict;
+	dbus_bool_t b = FALSE;
+	unsigned char strength = i % 100;
+
+	snprintf(path_buf, sizeof(path_buf), "/net/connman/service/"
+			"wifi_001122334455_%06d_managed_psk", i);
+	snprintf(name_buf, sizeof(name_buf), "network %d", i);
+	path = path_buf;
+	name = name_buf;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, NULL,
+			&object);
+	dbus_message_iter_append_basic(&object, DBUS_TYPE_OBJECT_PATH, &path);
+	dbus_message_iter_open_container(&object, DBUS_TYPE_ARRAY, "{sv}",
+			&dict);
+	append_entry(&dict, "Type", DBUS_TYPE_STRING, &type);
+	append_entry_strings(&dict, "Security", security, 1);
+	append_entry(&dict, "State", DBUS_TYPE_STRING, &state);
+	append_entry(&dict, "Strength", DBUS_TYPE_BYTE, &strength);
+	append_entry(&dict, "Favorite", DBUS_TYPE_BOOLEAN, &b);
+	append_entry(&dict, "Immutable", DBUS_TYPE_BOOLEAN, &b);
+	append_entry(&dict, "AutoConnect", DBUS_TYPE_BOOLEAN, &b);
+	append_entry(&dict, "Name", DBUS_TYPE_STRING, &name);
+	append_entry_dict(&dict, "Ethernet", ethernet, 3);
+	append_entry_dict(&dict, "IPv4", ipv4, 3);
+	append_entry_dict(&dict, "IPv6", NULL, 0);
+	append_entry_strings(&dict, "Nameservers", NULL, 0);
+	append_entry(&dict, "Provider.Host", DBUS_TYPE_STRING, &str);
+	dbus_message_iter_close_container(&object, &dict);
+	dbus_message_iter_close_container(array, &object);
+}
+
+static DBusMessage* get_services_new(int nb)
+{
+	DBusMessage *message = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+	DBusMessageIter iter, array;
+	int i;
+
+	dbus_message_iter_init_append(message, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(oa{sv})",
+			&array);
+
+	for (i = 0; i < nb; i++)
+		append_service(&array, i);
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return message;
+}
+
+// from json with workers < 0
+static void load(struct service_table *table, DBusMessage *message,
+		int workers)
+{
+	struct json_object *jservices;
+	DBusMessageIter iter;
+
+	dbus_message_iter_init(message, &iter);
+
+	if (workers >= 0) {
+		__service_table_load_dbus(table, &iter, workers);
+		return;
+	}
+
+	jservices = __connman_dbus_reply_to_json(&iter);
+	__service_table_load(table, jservices);
+	json_object_put(jservices);
+}
+
+static void bench(const char *name, struct service_table *table,
+		DBusMessage *message, int workers)
+{
+	double start, elapsed;
+	int i;
+
+	// the atoms are interned and the table grown by the first load
+	load(table, message, workers);
+
+	allocations = 0;
+	counting = true;
+	start = now();
+	load(table, message, workers);
+	elapsed = now() - start;
+	counting = false;
+
+	printf("[*] %-12s %8lu allocations (%5.1f per service), %8.0f us\n",
+			name, allocations, (double) allocations / services,
+			elapsed * 1e6);
+
+	start = now();
+	for (i = 0; i < LOADS; i++)
+		load(table, message, workers);
+
+	printf("[*] %-12s %8.0f us per load (%d loads)\n", name,
+			(now() - start) * 1e6 / LOADS, LOADS);
+}
+
+static bool same_tables(struct service_table *a, struct service_table *b)
+{
+	struct json_object *ja, *jb;
+	unsigned int i;
+	bool same = a->count == b->count;
+
+	for (i = 0; same && i < a->count; i++) {
+		ja = __service_table_to_json(a, i);
+		jb = __service_table_to_json(b, i);
+		same = strcmp(json_object_to_json_string(ja),
+				json_object_to_json_string(jb)) == 0;
+		json_object_put(ja);
+		json_object_put(jb);
+	}
+
+	return same;
+}
+
+int main(int argc, char *argv[])
+{
+	struct service_table *decoded, *borrowed, *parallel;
+	DBusMessage *message;
+	char name[32];
+	int workers;
+
+	if (argc > 1)
+		services = atoi(argv[1]);
+
+	message = get_services_new(services);
+	decoded = __service_table_new();
+	borrowed = __service_table_new();
+	parallel = __service_table_new();
+
+	printf("[*] GetServices (%d)\n", services);
+
+	bench("json", decoded, message, -1);
+	bench("borrowed", borrowed, message, 1);
+
+	printf("[*] same tables: %s\n", same_tables(decoded, borrowed) ?
+			"yes" : "MISMATCH");
+
+	for (workers = 2; workers <= 4; workers *= 2) {
+		snprintf(name, sizeof(name), "borrowed x%d", workers);
+		bench(name, parallel, message, workers);
+		printf("[*] same tables: %s\n", same_tables(decoded,
+					parallel) ? "yes" : "MISMATCH");
+	}
+
+	__service_table_free(decoded);
+	__service_table_free(borrowed);
+	__service_table_free(parallel);
+	dbus_message_unref(message);
+
+	return 0;
+}
@@ -0,0 +1,119 @@
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "json_utils.h"
+
+/*
+ * Cost of the validation of one engine query: parsing the trusted string
+ * and recompiling its regexes each time (what engine_query used to do),
+ * parsing it with the regexes cached by __match_strings, and a validator
+ * compiled once. The last case uses the named validators instead of the
+ * regexes.
+ */
+
+#define ITERATIONS 100000
+
+#define IPV4_REGEX "^(25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\\\\.(25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\\\\.(25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\\\\.(25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)$"
+
+static const struct {
+	const char *name;
+	const char *trusted;
+	const char *data;
+} cases[] = {
+	{ "connect",
+	"{ \"service\": \"(%5C%5C|/|([a-zA-Z]))+\" }",
+	"{ \"service\": \"/net/connman/service/wifi_001122334455_0001_managed_psk\" }" },
+	{ "config ipv4",
+	"{ \"service\": \"[a-zA-Z0-9_]+\", \"options\": { \"IPv4\": { "
+		"\"Method\": \"^(dhcp|manual|off)$\", "
+		"\"Address\": \"" IPV4_REGEX "\", "
+		"\"Netmask\": \"" IPV4_REGEX "\", "
+		"\"Gateway\": \"" IPV4_REGEX "\" } } }",
+	"{ \"service\": \"wifi_001122334455_0001_managed_psk\", \"options\": "
+		"{ \"IPv4\": { \"Method\": \"manual\", "
+		"\"Address\": \"192.168.1.12\", \"Netmask\": \"255.255.255.0\", "
+		"\"Gateway\": \"192.168.1.1\" } } }" },
+	{ "config @ipv4",
+	"{ \"service\": \"@dbus_name\", \"options\": { \"IPv4\": { "
+		"\"Method\": \"^(dhcp|manual|off)$\", "
+		"\"Address\": \"@ipv4\", "
+		"\"Netmask\": \"@ipv4\", "
+		"\"Gateway\": \"@ipv4\" } } }",
+	"{ \"service\": \"wifi_001122334455_0001_managed_psk\", \"options\": "
+		"{ \"IPv4\": { \"Method\": \"manual\", "
+		"\"Address\": \"192.168.1.12\", \"Netmask\": \"255.255.255.0\", "
+		"\"Gateway\": \"192.168.1.1\" } } }" },
+	{ NULL, },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main()
+{
+	struct json_object *jdata, *jtrusted;
+	struct json_validator *validator;
+	double start, before, cached, after;
+	int i, j, matched;
+
+	for (i = 0; cases[i].name; i++) {
+		jdata = json_tokener_parse(cases[i].data);
+		matched = 0;
+
+		start = now();
+
+		for (j = 0; j < ITERATIONS; j++) {
+			jtrusted = json_tokener_parse(cases[i].trusted);
+			matched += __json_type_dispatch(jdata, jtrusted);
+			json_object_put(jtrusted);
+			__match_strings_cache_clear();
+		}
+
+		before = (now() - start) * 1e9 / ITERATIONS;
+		start = now();
+
+		for (j = 0; j < ITERATIONS; j++) {
+			jtrusted = json_tokener_parse(cases[i].trusted);
+			matched += __json_type_dispatch(jdata, jtrusted);
+			json_object_put(jtrusted);
+		}
+
+		cached = (now() - start) * 1e9 / ITERATIONS;
+
+		jtrusted = json_tokener_parse(cases[i].trusted);
+		validator = __json_validator_compile(jtrusted);
+		json_object_put(jtrusted);
+
+		start = now();
+
+		for (j = 0; j < ITERATIONS; j++)
+			matched += __json_validator_match(validator, jdata);
+
+		after = (now() - start) * 1e9 / ITERATIONS;
+
+		printf("[*] %-12s parse + dispatch: %9.0f ns/query, "
+				"cached regexes: %7.0f ns/query, "
+				"compiled: %7.0f ns/query (x%.0f) %s\n",
+				cases[i].name, before, cached, after,
+				before / after,
+				matched == 3 * ITERATIONS ? "" : "MISMATCH");
+
+		__json_validator_free(validator);
+		json_object_put(jdata);
+	}
+
+	return 0;
+}
@@ -0,0 +1,414 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json/json.h>
+
+#include "cbor.h"
+
+enum cbor_major {
+	CBOR_UINT = 0,
+	CBOR_NEGINT = 1,
+	CBOR_BYTES = 2,
+	CBOR_TEXT = 3,
+	CBOR_ARRAY = 4,
+	CBOR_MAP = 5,
+	CBOR_TAG = 6,
+	CBOR_SIMPLE = 7,
+};
+
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_NULL 0xf6
+#define CBOR_FLOAT32 0xfa
+#define CBOR_FLOAT64 0xfb
+
+static int reserve(struct cbor_buffer *buf, size_t len)
+{
+	unsigned char *tmp;
+	size_t size;
+
+	if (buf->len + len <= buf->size)
+		return 0;
+
+	size = buf->size ? buf->size : 256;
+
+	while (size < buf->len + len)
+		size *= 2;
+
+	if (!(tmp = realloc(buf->data, size)))
+		return -ENOMEM;
+
+	buf->data = tmp;
+	buf->size = size;
+
+	return 0;
+}
+
+// the major type and its argument, in the shortest form
+static int put_head(struct cbor_buffer *buf, enum cbor_major major,
+		uint64_t val)
+{
+	unsigned char *pos;
+	int len, i;
+
+	if (val < 24)
+		len = 0;
+	else if (val <= UINT8_MAX)
+		len = 1;
+	else if (val <= UINT16_MAX)
+		len = 2;
+	else if (val <= UINT32_MAX)
+		len = 4;
+	else
+		len = 8;
+
+	if (reserve(buf, 1 + len) < 0)
+		return -ENOMEM;
+
+	pos = buf->data + buf->len;
+
+	if (len == 0)
+		*pos = major << 5 | val;
+	else
+		*pos = major << 5 | (len == 1 ? 24 : len == 2 ? 25 :
+				len == 4 ? 26 : 27);
+
+	for (i = len; i > 0; i--, val >>= 8)
+		pos[i] = val & 0xff;
+
+	buf->len += 1 + len;
+
+	return 0;
+}
+
+static int put_bytes(struct cbor_buffer *buf, const void *data, size_t len)
+{
+	if (reserve(buf, len) < 0)
+		return -ENOMEM;
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+
+	return 0;
+}
+
+static int put_text(struct cbor_buffer *buf, const char *str, size_t len)
+{
+	if (put_head(buf, CBOR_TEXT, len) < 0)
+		return -ENOMEM;
+
+	return put_bytes(buf, str, len);
+}
+
+static int put_double(struct cbor_buffer *buf, double d)
+{
+	unsigned char bytes[9];
+	uint64_t bits;
+	int i;
+
+	memcpy(&bits, &d, sizeof(bits));
+	bytes[0] = CBOR_FLOAT64;
+
+	for (i = 8; i > 0; i--, bits >>= 8)
+		bytes[i] = bits & 0xff;
+
+	return put_bytes(buf, bytes, sizeof(bytes));
+}
+
+int __cbor_encode(struct cbor_buffer *buf, struct json_object *jobj)
+{
+	unsigned char simple;
+	int64_t i;
+	int len, n;
+
+	switch (json_object_get_type(jobj)) {
+		case json_type_null:
+			simple = CBOR_NULL;
+			return put_bytes(buf, &simple, 1);
+
+		case json_type_boolean:
+			simple = json_object_get_boolean(jobj) ? CBOR_TRUE :
+				CBOR_FALSE;
+			return put_bytes(buf, &simple, 1);
+
+		case json_type_int:
+			i = json_object_get_int64(jobj);
+
+			if (i >= 0)
+				return put_head(buf, CBOR_UINT, i);
+
+			// -1 - n
+			return put_head(buf, CBOR_NEGINT, -(i + 1));
+
+		case json_type_double:
+			return put_double(buf, json_object_get_double(jobj));
+
+		case json_type_string:
+			return put_text(buf, json_object_get_string(jobj),
+					json_object_get_string_len(jobj));
+
+		case json_type_array:
+			len = json_object_array_length(jobj);
+
+			if (put_head(buf, CBOR_ARRAY, len) < 0)
+				return -ENOMEM;
+
+			for (n = 0; n < len; n++)
+				if (__cbor_encode(buf, json_object_array_get_idx(
+								jobj, n)) < 0)
+					return -ENOMEM;
+
+			return 0;
+
+		case json_type_object:
+			if (put_head(buf, CBOR_MAP,
+						json_object_object_length(jobj)) < 0)
+				return -ENOMEM;
+
+			json_object_object_foreach(jobj, key, val) {
+				if (put_text(buf, key, strlen(key)) < 0 ||
+						__cbor_encode(buf, val) < 0)
+					return -ENOMEM;
+			}
+
+			return 0;
+	}
+
+	return -EINVAL;
+}
+
+void __cbor_buffer_free(struct cbor_buffer *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = buf->size = 0;
+}
+
+struct decoder {
+	const unsigned char *pos;
+	const unsigned char *end;
+};
+
+static bool get_head(struct decoder *dec, enum cbor_major *major,
+		uint64_t *val)
+{
+	int len, info;
+
+	if (dec->pos >= dec->end)
+		return false;
+
+	*major = *dec->pos >> 5;
+	info = *dec->pos++ & 0x1f;
+
+	if (info < 24) {
+		*val = info;
+		return true;
+	}
+
+	// 24 to 27: 1, 2, 4 or 8 bytes follow, the rest isn't produced
+	if (info > 27)
+		return false;
+
+	len = 1 << (info - 24);
+
+	if (dec->end - dec->pos < len)
+		return false;
+
+	for (*val = 0; len > 0; len--)
+		*val = *val << 8 | *dec->pos++;
+
+	return true;
+}
+
+// a map key, the keys of json-c are nul terminated
+static char* decode_key(struct decoder *dec, uint64_t len)
+{
+	char *str;
+
+	if ((uint64_t) (dec->end - dec->pos) < len || !(str = malloc(len + 1)))
+		return NULL;
+
+	memcpy(str, dec->pos, len);
+	str[len] = '\0';
+	dec->pos += len;
+
+	return str;
+}
+
+static struct json_object* decode_simple(struct decoder *dec,
+		unsigned char simple, uint64_t val)
+{
+	uint64_t bits;
+	uint32_t bits32;
+	double d;
+	float f;
+
+	switch (simple) {
+		case CBOR_FALSE:
+			return json_object_new_boolean(FALSE);
+
+		case CBOR_TRUE:
+			return json_object_new_boolean(TRUE);
+
+		case CBOR_NULL:
+			return NULL;
+
+		case CBOR_FLOAT32:
+			bits32 = val;
+			memcpy(&f, &bits32, sizeof(f));
+			return json_object_new_double(f);
+
+		case CBOR_FLOAT64:
+			bits = val;
+			memcpy(&d, &bits, sizeof(d));
+			return json_object_new_double(d);
+	}
+
+	return NULL;
+}
+
+/*
+ * json null is the NULL object: *valid tells it apart from an error.
+ */
+static struct json_object* decode(struct decoder *dec, int depth,
+		bool *valid)
+{
+	struct json_object *res, *item;
+	enum cbor_major major, key_major;
+	unsigned char simple;
+	uint64_t val, key_len, i;
+	char *key;
+
+	*valid = false;
+
+	if (depth > CBOR_MAX_DEPTH || dec->pos >= dec->end)
+		return NULL;
+
+	simple = *dec->pos;
+
+	if (!get_head(dec, &major, &val))
+		return NULL;
+
+	switch (major) {
+		case CBOR_UINT:
+			if (val > INT64_MAX)
+				return NULL;
+
+			*valid = true;
+			return json_object_new_int64(val);
+
+		case CBOR_NEGINT:
+			if (val > INT64_MAX)
+				return NULL;
+
+			*valid = true;
+			return json_object_new_int64(-1 - (int64_t) val);
+
+		case CBOR_TEXT:
+			if ((uint64_t) (dec->end - dec->pos) < val ||
+					val > INT32_MAX)
+				return NULL;
+
+			res = json_object_new_string_len((const char *)
+					dec->pos, val);
+			dec->pos += val;
+			*valid = true;
+			return res;
+
+		case CBOR_ARRAY:
+			res = json_object_new_array();
+
+			for (i = 0; i < val; i++) {
+				item = decode(dec, depth + 1, valid);
+
+				if (!*valid) {
+					json_object_put(res);
+					return NULL;
+				}
+
+				json_object_array_add(res, item);
+			}
+
+			*valid = true;
+			return res;
+
+		case CBOR_MAP:
+			res = json_object_new_object();
+
+			for (i = 0; i < val; i++) {
+				if (!get_head(dec, &key_major, &key_len) ||
+						key_major != CBOR_TEXT ||
+						!(key = decode_key(dec, key_len))) {
+					json_object_put(res);
+					return NULL;
+				}
+
+				item = decode(dec, depth + 1, valid);
+
+				if (!*valid) {
+					free(key);
+					json_object_put(res);
+					return NULL;
+				}
+
+				json_object_object_add(res, key, item);
+				free(key);
+			}
+
+			*valid = true;
+			return res;
+
+		case CBOR_SIMPLE:
+			if (simple != CBOR_FALSE && simple != CBOR_TRUE &&
+					simple != CBOR_NULL &&
+					simple != CBOR_FLOAT32 &&
+					simple != CBOR_FLOAT64)
+				return NULL;
+
+			*valid = true;
+			return decode_simple(dec, simple, val);
+
+		default:
+			return NULL;
+	}
+}
+
+struct json_object* __cbor_decode(const unsigned char *data, size_t len)
+{
+	struct decoder dec = { data, data + len };
+	struct json_object *res;
+	bool valid;
+
+	res = decode(&dec, 0, &valid);
+
+	if (valid && dec.pos == dec.end)
+		return res;
+
+	json_object_put(res);
+
+	return NULL;
+}
@@ -0,0 +1,61 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_CBOR_H
+#define __CONNMAN_CBOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <json/json.h>
+
+/* deeper items are refused by __cbor_decode */
+#define CBOR_MAX_DEPTH 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CBOR (RFC 7049) of a json object, encoded from the json-c tree itself:
+ * null, booleans, 64 bits integers, doubles, strings, arrays and maps with
+ * string keys, all of definite length.
+ */
+
+struct cbor_buffer {
+	unsigned char *data;
+	size_t len;
+	size_t size;
+};
+
+/* appends the encoding of jobj to buf, -ENOMEM on failure */
+int __cbor_encode(struct cbor_buffer *buf, struct json_object *jobj);
+
+void __cbor_buffer_free(struct cbor_buffer *buf);
+
+/*
+ * What __cbor_encode gives, NULL if data isn't exactly one such item (or
+ * is a json null).
+ */
+struct json_object* __cbor_decode(const unsigned char *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
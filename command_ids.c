@@ -0,0 +1,108 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "command_ids.h"
+
+/* a power of 2, at least 4 times the number of commands */
+#define COMMAND_SLOTS 128
+
+static const char *command_names[] = {
+#define COMMAND_NAME(id, name) name,
+	COMMANDS(COMMAND_NAME)
+#undef COMMAND_NAME
+	NULL,
+};
+
+/*
+ * A perfect hash of the command names: the seed is chosen (once) so that
+ * no two names fall in the same slot. A lookup is one hash and one strcmp.
+ * slots[] holds id + 1, 0 is an empty slot.
+ */
+static uint32_t seed;
+static uint8_t slots[COMMAND_SLOTS];
+static pthread_once_t slots_once = PTHREAD_ONCE_INIT;
+
+static uint32_t hash_name(uint32_t seed, const char *name)
+{
+	uint32_t hash = 2166136261u ^ seed;
+
+	while (*name) {
+		hash ^= (unsigned char) *name++;
+		hash *= 16777619u;
+	}
+
+	return hash & (COMMAND_SLOTS - 1);
+}
+
+static void slots_build(void)
+{
+	uint32_t h;
+	int i;
+
+	assert(CMD_UNKNOWN * 4 <= COMMAND_SLOTS);
+
+	for (seed = 0; ; seed++) {
+		memset(slots, 0, sizeof(slots));
+
+		for (i = 0; i < CMD_UNKNOWN; i++) {
+			h = hash_name(seed, command_names[i]);
+
+			if (slots[h])
+				break;
+
+			slots[h] = i + 1;
+		}
+
+		if (i == CMD_UNKNOWN)
+			return;
+	}
+}
+
+/*
+ * The id of the command name, CMD_UNKNOWN if there isn't such a command.
+ */
+enum command_id __command_id(const char *name)
+{
+	uint8_t slot;
+
+	if (!name)
+		return CMD_UNKNOWN;
+
+	pthread_once(&slots_once, slots_build);
+	slot = slots[hash_name(seed, name)];
+
+	if (slot && strcmp(command_names[slot - 1], name) == 0)
+		return slot - 1;
+
+	return CMD_UNKNOWN;
+}
+
+const char* __command_name(enum command_id id)
+{
+	return id < CMD_UNKNOWN ? command_names[id] : NULL;
+}
@@ -0,0 +1,67 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_COMMAND_IDS_H
+#define __CONNMAN_COMMAND_IDS_H
+
+/*
+ * Every command understood by the engine (engine_query) or by the connman
+ * dispatcher (__connman_command_dispatcher), listed once: X(id, name).
+ * Both tables are indexed by the ids generated from this list.
+ */
+#define COMMANDS(X) \
+	X(GET_STATE, "get_state") \
+	X(GET_SERVICES, "get_services") \
+	X(GET_TECHNOLOGIES, "get_technologies") \
+	X(GET_HOME_PAGE, "get_home_page") \
+	X(GET_SERVICES_FROM_TECH, "get_services_from_tech") \
+	X(GET_ATOMS_STATS, "get_atoms_stats") \
+	X(GET_LOOP_STATS, "get_loop_stats") \
+	X(GET_LATENCY, "get_latency") \
+	X(BATCH, "batch") \
+	X(CONNECT, "connect") \
+	X(DISCONNECT, "disconnect") \
+	X(CONFIG, "config") \
+	X(REMOVE, "remove") \
+	X(SCAN, "scan") \
+	X(ENABLE, "enable") \
+	X(DISABLE, "disable") \
+	X(AGENT_REGISTER, "agent_register") \
+	X(AGENT_UNREGISTER, "agent_unregister")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum command_id {
+#define COMMAND_ENUM(id, name) CMD_##id,
+	COMMANDS(COMMAND_ENUM)
+#undef COMMAND_ENUM
+	CMD_UNKNOWN,	// this is also the number of commands
+};
+
+enum command_id __command_id(const char *name);
+
+const char* __command_name(enum command_id id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <assert.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -34,6 +35,10 @@
 #include "dbus_json.h"
 #include "engine.h"
 #include "keys.h"
+#include "atoms.h"
+#include "validators.h"
+#include "command_ids.h"
+#include "latency.h"
 
 #include "commands.h"
 
@@ -41,36 +46,20 @@ extern DBusConnection *connection;
 
 extern void (*commands_callback)(struct json_object *data, json_bool is_error);
 
-extern void (*commands_signal)(struct json_object *data);
+extern void (*commands_signal)(struct json_object *data, bool applied);
+
+extern bool (*commands_property_changed)(DBusMessage *message,
+		bool *applied);
 
 void (*commands_callback)(struct json_object *data, json_bool is_error) = NULL;
-void (*commands_signal)(struct json_object *data) = NULL;
+void (*commands_signal)(struct json_object *data, bool applied) = NULL;
+bool (*commands_property_changed)(DBusMessage *message,
+		bool *applied) = NULL;
 
 
-static bool check_dbus_name(const char *name)
+static const char* get_path(const char *full_path)
 {
-	/*
-	 * Valid dbus chars should be [A-Z][a-z][0-9]_
-	 * and should not start with number.
-	 */
-	unsigned int i;
-
-	if (!name || name[0] == '\0')
-		return false;
-
-	for (i = 0; name[i] != '\0'; i++)
-		if (!((name[i] >= 'A' && name[i] <= 'Z') ||
-					(name[i] >= 'a' && name[i] <= 'z') ||
-					(name[i] >= '0' && name[i] <= '9') ||
-					name[i] == '_'))
-			return false;
-
-	return true;
-}
-
-static char* get_path(char *full_path)
-{
-	char *path;
+	const char *path;
 
 	path = strrchr(full_path, '/');
 	if (path && *path != '\0')
@@ -81,36 +70,121 @@ static char* get_path(char *full_path)
 	return path;
 }
 
-static void call_return_list(DBusMessageIter *iter, const char *error,
-		void *user_data)
+static struct json_object* return_list_json(DBusMessageIter *iter,
+		const char *error, void *user_data, json_bool *jerror)
 {
 	struct json_object *res, *array;
-	json_bool jerror;
 
 	if (error) {
 		res = json_object_new_object();
 		array = json_object_new_array();
 
 		if (user_data)
-			json_object_array_add(array, json_object_new_string(user_data));
+			json_object_array_add(array,
+					json_object_new_string(get_path(user_data)));
 
 		json_object_array_add(array, json_object_new_string(error));
 		json_object_object_add(res, key_dbus_json_error_key, array);
-		jerror = TRUE;
+		*jerror = TRUE;
 
 	} else {
-		res = __connman_dbus_to_json(iter);
-		jerror = FALSE;
+		res = __connman_dbus_reply_to_json(iter);
+		*jerror = FALSE;
 	}
 
+	return res;
+}
+
+static void call_return_list(DBusMessageIter *iter, const char *error,
+		void *user_data)
+{
+	struct json_object *res;
+	json_bool jerror;
+
+	res = return_list_json(iter, error, user_data, &jerror);
 	commands_callback(res, jerror);
 }
 
-static void call_return_list_free(DBusMessageIter *iter,
-		const char *error, void *user_data)
+/*
+ * The request was sent for a path from __atom_ref_printf: the
+ * reply releases it, a request that couldn't be sent releases it now.
+ */
+static void call_return_path(DBusMessageIter *iter, const char *error,
+		void *user_data)
 {
-	call_return_list(iter, error, get_path(user_data));
-	free(user_data);
+	call_return_list(iter, error, user_data);
+	__atom_unref(user_data);
+}
+
+static int path_call_sent(const char *path, int res)
+{
+	if (res != -EINPROGRESS)
+		__atom_unref(path);
+
+	return res;
+}
+
+/*
+ * Replies to a request sent with its own callback don't go through
+ * commands_callback. A peek callback sees the reply before it is decoded
+ * and can take it as it is.
+ */
+struct commands_reply {
+	commands_reply_func_t cb;
+	commands_peek_func_t peek;
+	void *user_data;
+};
+
+static void call_return_reply(DBusMessageIter *iter, const char *error,
+		void *user_data)
+{
+	struct commands_reply *reply = user_data;
+	struct json_object *res;
+	json_bool jerror;
+
+	if (!error && reply->peek && reply->peek(iter, reply->user_data)) {
+		free(reply);
+		return;
+	}
+
+	res = return_list_json(iter, error, NULL, &jerror);
+	reply->cb(res, jerror, reply->user_data);
+	free(reply);
+}
+
+static int method_call(const char *path, const char *interface,
+		const char *method, commands_reply_func_t cb,
+		commands_peek_func_t peek, void *user_data)
+{
+	struct commands_reply *reply;
+	int res;
+
+	if (!cb)
+		return __connman_dbus_method_call(connection,
+				key_connman_service, path, interface, method,
+				call_return_list, NULL, NULL, NULL);
+
+	reply = malloc(sizeof(struct commands_reply));
+	assert(reply != NULL);
+	reply->cb = cb;
+	reply->peek = peek;
+	reply->user_data = user_data;
+
+	res = __connman_dbus_method_call(connection, key_connman_service,
+			path, interface, method, call_return_reply, reply,
+			NULL, NULL);
+
+	if (res != -EINPROGRESS)
+		free(reply);
+
+	return res;
+}
+
+static int manager_method_call(const char *method, commands_reply_func_t cb,
+		void *user_data)
+{
+	return method_call(key_connman_path, "net.connman.Manager", method, cb,
+			NULL, user_data);
 }
 
 /*
@@ -118,28 +192,24 @@ static void call_return_list_free(DBusMessageIter *iter,
  */
 static int cmd_enable(struct json_object *jobj)
 {
-	char *tech;
-	const char *arg = json_object_get_string(jobj);
+	const char *tech, *arg = json_object_get_string(jobj);
 	dbus_bool_t b = TRUE;
 
-	if (check_dbus_name(arg) == false)
+	if (__validate_dbus_name(arg) == false)
 		return -EINVAL;
 
-	if (strcmp(arg, "offline") == 0) {
-		tech = strndup(arg, JSON_COMMANDS_STRING_SIZE_SMALL);
+	if (strcmp(arg, "offline") == 0)
 		return __connman_dbus_set_property(connection, "/",
-				"net.connman.Manager", call_return_list_free,
-				tech, "OfflineMode", DBUS_TYPE_BOOLEAN, &b);
-	}
+				"net.connman.Manager", call_return_list,
+				(void *) "offline", "OfflineMode",
+				DBUS_TYPE_BOOLEAN, &b);
 
-	tech = malloc(JSON_COMMANDS_STRING_SIZE_MEDIUM + 1);
-	snprintf(tech, JSON_COMMANDS_STRING_SIZE_MEDIUM,
-			"/net/connman/technology/%s", arg);
-	tech[JSON_COMMANDS_STRING_SIZE_MEDIUM] = '\0';
+	tech = __atom_ref_printf("/net/connman/technology/%s", arg);
 
-	return __connman_dbus_set_property(connection, tech,
-			"net.connman.Technology", call_return_list_free, tech,
-			"Powered", DBUS_TYPE_BOOLEAN, &b);
+	return path_call_sent(tech, __connman_dbus_set_property(connection,
+				tech, "net.connman.Technology",
+				call_return_path, (void *) tech, "Powered",
+				DBUS_TYPE_BOOLEAN, &b));
 }
 
 /*
@@ -147,56 +217,61 @@ static int cmd_enable(struct json_object *jobj)
  */
 static int cmd_disable(struct json_object *jobj)
 {
-	char *tech;
-	const char *arg = json_object_get_string(jobj);
+	const char *tech, *arg = json_object_get_string(jobj);
 	dbus_bool_t b = FALSE;
 
-	if (check_dbus_name(arg) == false)
+	if (__validate_dbus_name(arg) == false)
 		return -EINVAL;
 
-	if (strcmp(arg, "offline") == 0) {
-		tech = strndup(arg, JSON_COMMANDS_STRING_SIZE_SMALL);
+	if (strcmp(arg, "offline") == 0)
 		return __connman_dbus_set_property(connection, "/",
-				"net.connman.Manager", call_return_list_free,
-				tech, "OfflineMode", DBUS_TYPE_BOOLEAN, &b);
-	}
+				"net.connman.Manager", call_return_list,
+				(void *) "offline", "OfflineMode",
+				DBUS_TYPE_BOOLEAN, &b);
+
+	tech = __atom_ref_printf("/net/connman/technology/%s", arg);
 
-	tech = malloc(JSON_COMMANDS_STRING_SIZE_MEDIUM + 1);
-	snprintf(tech, JSON_COMMANDS_STRING_SIZE_MEDIUM,
-			"/net/connman/technology/%s", arg);
-	tech[JSON_COMMANDS_STRING_SIZE_MEDIUM] = '\0';
+	return path_call_sent(tech, __connman_dbus_set_property(connection,
+				tech, "net.connman.Technology",
+				call_return_path, (void *) tech, "Powered",
+				DBUS_TYPE_BOOLEAN, &b));
+}
 
-	return __connman_dbus_set_property(connection, tech,
-			"net.connman.Technology", call_return_list_free, tech,
-			"Powered", DBUS_TYPE_BOOLEAN, &b);
+/*
+ * With cb NULL the reply goes to commands_callback.
+ */
+int __cmd_state(commands_reply_func_t cb, void *user_data)
+{
+	return manager_method_call("GetProperties", cb, user_data);
 }
 
-int __cmd_state(void)
+int __cmd_services(commands_reply_func_t cb, void *user_data)
 {
-	return __connman_dbus_method_call(connection, key_connman_service,
-			key_connman_path, "net.connman.Manager", "GetProperties",
-			call_return_list, NULL, NULL, NULL);
+	return manager_method_call("GetServices", cb, user_data);
 }
 
-int __cmd_services(void)
+/*
+ * The reply goes to peek first, only valid for the time of the call: if
+ * it returns false, it is decoded and given to cb like __cmd_services.
+ * Errors always go to cb.
+ */
+int __cmd_services_peek(commands_reply_func_t cb, commands_peek_func_t peek,
+		void *user_data)
 {
-	return __connman_dbus_method_call(connection, key_connman_service,
-			key_connman_path, "net.connman.Manager", "GetServices",
-			call_return_list, NULL, NULL, NULL);
+	return method_call(key_connman_path, "net.connman.Manager",
+			"GetServices", cb, peek, user_data);
 }
 
-int __cmd_technologies(void)
+int __cmd_technologies(commands_reply_func_t cb, void *user_data)
 {
-	return __connman_dbus_method_call(connection, key_connman_service,
-			key_connman_path, "net.connman.Manager", "GetTechnologies",
-			call_return_list, NULL,	NULL, NULL);
+	return manager_method_call("GetTechnologies", cb, user_data);
 }
 
-int __cmd_connect_full_name(const char *serv_dbus_name)
+int __cmd_connect_full_name(const char *serv_dbus_name,
+		commands_reply_func_t cb, void *user_data)
 {
-	return __connman_dbus_method_call(connection, key_connman_service,
-			serv_dbus_name, "net.connman.Service", "Connect",
-			call_return_list, NULL, NULL, NULL);
+	return method_call(serv_dbus_name, "net.connman.Service", "Connect",
+			cb, NULL, user_data);
 }
 
 /*
@@ -204,17 +279,17 @@ int __cmd_connect_full_name(const char *serv_dbus_name)
  */
 static int cmd_scan(struct json_object *jobj)
 {
-	char *path;
-	const char *arg = json_object_get_string(jobj);
+	const char *path, *arg = json_object_get_string(jobj);
 
-	path = malloc(JSON_COMMANDS_STRING_SIZE_MEDIUM + 1);
-	snprintf(path, JSON_COMMANDS_STRING_SIZE_MEDIUM,
-			"/net/connman/technology/%s", arg);
-	path[JSON_COMMANDS_STRING_SIZE_MEDIUM] = '\0';
+	if (__validate_dbus_name(arg) == false)
+		return -EINVAL;
+
+	path = __atom_ref_printf("/net/connman/technology/%s", arg);
 
-	return __connman_dbus_method_call(connection, key_connman_service,
-			path, "net.connman.Technology", "Scan",
-			call_return_list_free, path, NULL, NULL);
+	return path_call_sent(path, __connman_dbus_method_call(connection,
+				key_connman_service, path,
+				"net.connman.Technology", "Scan",
+				call_return_path, (void *) path, NULL, NULL));
 }
 
 /*
@@ -222,20 +297,17 @@ static int cmd_scan(struct json_object *jobj)
  */
 static int cmd_connect(struct json_object *jobj)
 {
-	char *path;
-	const char *arg = json_object_get_string(jobj);
+	const char *path, *arg = json_object_get_string(jobj);
 
-	if (check_dbus_name(arg) == false)
+	if (__validate_dbus_name(arg) == false)
 		return -EINVAL;
 
-	path = malloc(JSON_COMMANDS_STRING_SIZE_MEDIUM + 1);
-	snprintf(path, JSON_COMMANDS_STRING_SIZE_MEDIUM,
-			"/net/connman/service/%s", arg);
-	path[JSON_COMMANDS_STRING_SIZE_MEDIUM] = '\0';
+	path = __atom_ref_printf("/net/connman/service/%s", arg);
 
-	return __connman_dbus_method_call(connection, key_connman_service, path,
-			"net.connman.Service", "Connect", call_return_list_free,
-			path, NULL, NULL);
+	return path_call_sent(path, __connman_dbus_method_call(connection,
+				key_connman_service, path,
+				"net.connman.Service", "Connect",
+				call_return_path, (void *) path, NULL, NULL));
 }
 
 /*
@@ -243,20 +315,17 @@ static int cmd_connect(struct json_object *jobj)
  */
 static int cmd_disconnect(struct json_object *jobj)
 {
-	char *path;
-	const char *arg = json_object_get_string(jobj);
+	const char *path, *arg = json_object_get_string(jobj);
 
-	if (check_dbus_name(arg) == false)
+	if (__validate_dbus_name(arg) == false)
 		return -EINVAL;
 
-	path = malloc(JSON_COMMANDS_STRING_SIZE_MEDIUM + 1);
-	snprintf(path, JSON_COMMANDS_STRING_SIZE_MEDIUM,
-			"/net/connman/service/%s", arg);
-	path[JSON_COMMANDS_STRING_SIZE_MEDIUM] = '\0';
+	path = __atom_ref_printf("/net/connman/service/%s", arg);
 
-	return __connman_dbus_method_call(connection, key_connman_service, path,
-			"net.connman.Service", "Disconnect",
-			call_return_list_free, path, NULL, NULL);
+	return path_call_sent(path, __connman_dbus_method_call(connection,
+				key_connman_service, path,
+				"net.connman.Service", "Disconnect",
+				call_return_path, (void *) path, NULL, NULL));
 }
 
 /*
@@ -264,20 +333,17 @@ static int cmd_disconnect(struct json_object *jobj)
  */
 static int cmd_remove(struct json_object *jobj)
 {
-	char *path;
-	const char *arg = json_object_get_string(jobj);
+	const char *path, *arg = json_object_get_string(jobj);
 
-	if (check_dbus_name(arg) == false)
+	if (__validate_dbus_name(arg) == false)
 		return -EINVAL;
 
-	path = malloc(JSON_COMMANDS_STRING_SIZE_MEDIUM + 1);
-	snprintf(path, JSON_COMMANDS_STRING_SIZE_MEDIUM,
-			"/net/connman/service/%s", arg);
-	path[JSON_COMMANDS_STRING_SIZE_MEDIUM] = '\0';
+	path = __atom_ref_printf("/net/connman/service/%s", arg);
 
-	return __connman_dbus_method_call(connection, key_connman_service, path,
-			"net.connman.Service", "Remove", call_return_list_free,
-			path, NULL, NULL);
+	return path_call_sent(path, __connman_dbus_method_call(connection,
+				key_connman_service, path,
+				"net.connman.Service", "Remove",
+				call_return_path, (void *) path, NULL, NULL));
 }
 
 static void config_append_ipv4(DBusMessageIter *iter,
@@ -440,8 +506,8 @@ static void config_append_proxy(DBusMessageIter *iter,
 static int cmd_config(struct json_object *jobj)
 {
 	int res = 0;
-	const char *service_name;
-	char *path, *simple_service_conf, *dyn_service_name;
+	const char *service_name, *path;
+	char *simple_service_conf;
 	dbus_bool_t dbus_bool;
 	struct json_object *options, *srvobj;
 
@@ -451,7 +517,7 @@ static int cmd_config(struct json_object *jobj)
 	}
 
 	service_name = json_object_get_string(srvobj);
-	if (!service_name || check_dbus_name(service_name) == false) {
+	if (!service_name || __validate_dbus_name(service_name) == false) {
 		call_return_list(NULL, "Wrong service name",
 				"Service set properties.");
 		return -EINVAL;
@@ -465,32 +531,27 @@ static int cmd_config(struct json_object *jobj)
 
 	json_object_object_foreach(options, key, val) {
 		simple_service_conf = NULL;
-		path = malloc(JSON_COMMANDS_STRING_SIZE_MEDIUM + 1);
-		snprintf(path, JSON_COMMANDS_STRING_SIZE_MEDIUM,
-				"/net/connman/service/%s", service_name);
-		path[JSON_COMMANDS_STRING_SIZE_MEDIUM] = '\0';
-
-		dyn_service_name = strndup(service_name,
-				JSON_COMMANDS_STRING_SIZE_MEDIUM);
+		path = __atom_ref_printf("/net/connman/service/%s",
+				service_name);
 
 		if (strcmp("IPv4", key) == 0) {
 			res = __connman_dbus_set_property_dict(connection,
 					path, "net.connman.Service",
-					call_return_list_free, dyn_service_name,
+					call_return_path, (void *) path,
 					"IPv4.Configuration", DBUS_TYPE_STRING,
 					config_append_ipv4, val);
 
 		} else if (strcmp("IPv6", key) == 0) {
 			res = __connman_dbus_set_property_dict(connection,
 					path, "net.connman.Service",
-					call_return_list_free, dyn_service_name,
+					call_return_path, (void *) path,
 					"IPv6.Configuration", DBUS_TYPE_STRING,
 					config_append_ipv6, val);
 
 		} else if (strcmp("Proxy", key) == 0) {
 			res = __connman_dbus_set_property_dict(connection,
 					path, "net.connman.Service",
-					call_return_list_free, dyn_service_name,
+					call_return_path, (void *) path,
 					"Proxy.Configuration", DBUS_TYPE_STRING,
 					config_append_proxy, val);
 
@@ -502,8 +563,8 @@ static int cmd_config(struct json_object *jobj)
 				dbus_bool = FALSE;
 
 			res = __connman_dbus_set_property(connection, path,
-					"net.connman.Service", call_return_list_free,
-					dyn_service_name, "AutoConnect",
+					"net.connman.Service", call_return_path,
+					(void *) path, "AutoConnect",
 					DBUS_TYPE_BOOLEAN, &dbus_bool);
 
 		} else if (strcmp("Domains", key) == 0)
@@ -515,22 +576,20 @@ static int cmd_config(struct json_object *jobj)
 		else if (strcmp("Timeservers", key) == 0)
 			simple_service_conf = "Timeservers.Configuration";
 		else {
-			char *str = strndup(key, JSON_COMMANDS_STRING_SIZE_SMALL);
-			call_return_list_free(NULL, "Unknown configuration key", str);
+			call_return_list(NULL, "Unknown configuration key", key);
 			res = -EINVAL;
 		}
 
 		if (simple_service_conf != NULL) {
 			res = __connman_dbus_set_property_array(connection,
 					path, "net.connman.Service",
-					call_return_list_free,
-					dyn_service_name,
+					call_return_path, (void *) path,
 					simple_service_conf, DBUS_TYPE_STRING,
 					config_append_json_array_of_strings, val);
 		}
 
-		free(path);
 		simple_service_conf = NULL;
+		path_call_sent(path, res);
 
 		if (res < 0 && res != -EINPROGRESS)
 			return res;
@@ -542,9 +601,10 @@ static int cmd_config(struct json_object *jobj)
 static DBusHandlerResult monitor_changed(DBusConnection *connection,
 		DBusMessage *message, void *user_data)
 {
-	DBusMessageIter iter;
 	const char *interface, *path;
 	struct json_object *res, *sig_name;
+	bool applied = false;
+	uint64_t start;
 
 	interface = dbus_message_get_interface(message);
 	if (!interface)
@@ -558,6 +618,17 @@ static DBusHandlerResult monitor_changed(DBusConnection *connection,
 			!strcmp(interface, "net.connman.Notification"))
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
+	// no json at all if it is taken care of
+	if (commands_property_changed && dbus_message_is_signal(message,
+				"net.connman.Service", "PropertyChanged")) {
+		start = __latency_now();
+
+		if (commands_property_changed(message, &applied)) {
+			__latency_record(LATENCY_SIGNAL, start);
+			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+		}
+	}
+
 	interface = strrchr(interface, '.');
 	if (interface && *interface != '\0')
 		interface++;
@@ -568,47 +639,48 @@ static DBusHandlerResult monitor_changed(DBusConnection *connection,
 
 	if (dbus_message_is_signal(message, "net.connman.Manager",
 				"ServicesChanged")) {
-		sig_name = json_object_new_string("ServicesChanged");
+		sig_name = __atom_json(__atom_intern("ServicesChanged"));
 
 	} else if (dbus_message_is_signal(message, "net.connman.Manager",
 				"PropertyChanged")) {
-		sig_name = json_object_new_string("PropertyChanged");
+		sig_name = __atom_json(__atom_intern("PropertyChanged"));
 
 	} else if (dbus_message_is_signal(message, "net.connman.Manager",
 				"TechnologyAdded")) {
 		path = dbus_message_get_member(message);
-		sig_name = json_object_new_string("TechnologyAdded");
+		sig_name = __atom_json(__atom_intern("TechnologyAdded"));
 
 	} else if (dbus_message_is_signal(message, "net.connman.Manager",
 				"TechnologyRemoved")) {
 		path = dbus_message_get_member(message);
-		sig_name = json_object_new_string("TechnologyRemoved");
+		sig_name = __atom_json(__atom_intern("TechnologyRemoved"));
 
 	} else if (dbus_message_is_signal(message, "net.connman.Service",
 				"PropertyChanged")) {
-		sig_name = json_object_new_string("PropertyChanged");
+		sig_name = __atom_json(__atom_intern("PropertyChanged"));
 
 	} else if (dbus_message_is_signal(message, "net.connman.Technology",
 				"PropertyChanged")) {
-		sig_name = json_object_new_string("PropertyChanged");
+		sig_name = __atom_json(__atom_intern("PropertyChanged"));
 
 	} else {
-		sig_name = json_object_new_string("Signal unsupported");
+		sig_name = __atom_json(__atom_intern("Signal unsupported"));
 	}
 
-	dbus_message_iter_init(message, &iter);
 	res = json_object_new_object();
 
 	json_object_object_add(res, key_command_interface,
-			json_object_new_string(interface));
+			__atom_json(__atom_intern(interface)));
 	json_object_object_add(res, key_command_path,
-			json_object_new_string(path));
-	json_object_object_add(res, key_command_data, __connman_dbus_to_json(&iter));
+			__atom_json_lookup(path));
+	json_object_object_add(res, key_command_data,
+			__connman_dbus_message_to_json(message));
 
 	json_object_object_add(res, key_dbus_json_signal_key, sig_name);
-	json_object_get(res);
 
-	commands_signal(res);
+	start = __latency_now();
+	commands_signal(res, applied);
+	__latency_record(LATENCY_SIGNAL, start);
 
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
@@ -774,54 +846,49 @@ int __connman_command_dispatcher(DBusConnection *dbus_conn,
 	if (!json_object_object_get_ex(jobj, "data", &data))
 		data = NULL;
 
-	if (strcmp(command, "config") == 0)
-		res = cmd_config(data);
+	switch (__command_id(command)) {
 
-	else if (strcmp(command, "remove") == 0)
-		res = cmd_remove(data);
+		case CMD_CONFIG:
+			res = cmd_config(data);
+			break;
 
-	else if (strcmp(command, "disconnect") == 0)
-		res = cmd_disconnect(data);
+		case CMD_REMOVE:
+			res = cmd_remove(data);
+			break;
 
-	else if (strcmp(command, "connect") == 0)
-		res = cmd_connect(data);
+		case CMD_DISCONNECT:
+			res = cmd_disconnect(data);
+			break;
 
-	else if (strcmp(command, "scan") == 0)
-		res = cmd_scan(data);
+		case CMD_CONNECT:
+			res = cmd_connect(data);
+			break;
 
-	/*
-	else if (strcmp(command, "technologies") == 0)
-		res = cmd_technologies();
+		case CMD_SCAN:
+			res = cmd_scan(data);
+			break;
 
-	else if (strcmp(command, "services") == 0)
-		res = cmd_services();
+		case CMD_DISABLE:
+			res = cmd_disable(data);
+			break;
 
-	else if (strcmp(command, "state") == 0)
-		res = cmd_state();
-	*/
+		case CMD_ENABLE:
+			res = cmd_enable(data);
+			break;
 
-	else if (strcmp(command, "disable") == 0)
-		res = cmd_disable(data);
+		case CMD_AGENT_REGISTER:
+			res = __connman_agent_register(connection);
+			break;
 
-	else if (strcmp(command, "enable") == 0)
-		res = cmd_enable(data);
+		case CMD_AGENT_UNREGISTER:
+			__connman_agent_unregister(connection, NULL);
+			res = 0;
+			break;
 
-	else if (strcmp(command, "agent_register") == 0)
-		res = __connman_agent_register(connection);
-
-	else if (strcmp(command, "agent_unregister") == 0) {
-		__connman_agent_unregister(connection, NULL);
-		res = 0;
-	}
-
-	/*
-	else if (strcmp(command, "monitor") == 0)
-		res = cmd_monitor(data);
-	*/
-
-	else {
-		res = -EINVAL;
-		call_return_list(NULL, "Unknown command", "");
+		default:
+			res = -EINVAL;
+			call_return_list(NULL, "Unknown command", "");
+			break;
 	}
 
 	json_object_put(jobj);
@@ -20,6 +20,7 @@
 #ifndef __CONNMAN_COMMANDS_H
 #define __CONNMAN_COMMANDS_H
 
+#include <stdbool.h>
 #include <dbus/dbus.h>
 #include <json/json.h>
 
@@ -33,20 +34,38 @@ extern "C" {
 #endif
 
 extern void (*commands_callback)(struct json_object *data, json_bool is_error);
-extern void (*commands_signal)(struct json_object *data);
+extern void (*commands_signal)(struct json_object *data, bool applied);
 
-int __cmd_state(void);
+/*
+ * Called with a Service PropertyChanged before it is decoded: if it returns
+ * true the signal was handled and commands_signal isn't called. Otherwise
+ * *applied is given to commands_signal, true when the hook already took the
+ * change into account and only the json is still wanted.
+ */
+extern bool (*commands_property_changed)(DBusMessage *message, bool *applied);
+
+typedef void (*commands_reply_func_t)(struct json_object *data,
+		json_bool is_error, void *user_data);
+
+int __cmd_state(commands_reply_func_t cb, void *user_data);
+
+int __cmd_services(commands_reply_func_t cb, void *user_data);
+
+typedef bool (*commands_peek_func_t)(DBusMessageIter *iter,
+		void *user_data);
 
-int __cmd_services(void);
+int __cmd_services_peek(commands_reply_func_t cb, commands_peek_func_t peek,
+		void *user_data);
 
-int __cmd_technologies(void);
+int __cmd_technologies(commands_reply_func_t cb, void *user_data);
 
 int __cmd_monitor(struct json_object *jobj);
 
 int __connman_command_dispatcher(DBusConnection *dbus_conn,
 	struct json_object *jobj);
 
-int __cmd_connect_full_name(const char *serv_dbus_name);
+int __cmd_connect_full_name(const char *serv_dbus_name,
+		commands_reply_func_t cb, void *user_data);
 
 #ifdef __cplusplus
 }
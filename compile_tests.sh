@@ -1,10 +1,28 @@
 #!/bin/bash
 
-FLAGS="-ljson -Wall -std=c99 -g -O0"
+FLAGS="-ljson -lpthread -Wall -std=c99 -g -O0"
 CC="gcc"
 
 # test_json_utils
-$CC $FLAGS -o test_json_utils test_json_utils.c json_utils.o
+$CC $FLAGS -o test_json_utils test_json_utils.c json_utils.o validators.o atoms.o
+
+# bench_validation
+$CC $FLAGS -o bench_validation bench_validation.c json_utils.o validators.o atoms.o
+
+# bench_cbor
+$CC $FLAGS -o bench_cbor bench_cbor.c cbor.o
 
 # main_simple_commands
-$CC $FLAGS -o main_simple_commands main_simple_commands.c -I/usr/include/dbus-1.0/ -I/usr/lib64/dbus-1.0/include -ldbus-1 -ljson -lncurses loop.o engine.o commands.o dbus_helpers.o json_utils.o dbus_json.o agent.o
+$CC $FLAGS -o main_simple_commands main_simple_commands.c -I/usr/include/dbus-1.0/ -I/usr/lib64/dbus-1.0/include -ldbus-1 -ljson -lncurses loop.o engine.o commands.o dbus_helpers.o json_utils.o validators.o dbus_json.o agent.o command_ids.o service_table.o atoms.o spsc_ring.o latency.o snapshot.o keys.o
+
+# bench_fanout
+$CC $FLAGS -o bench_fanout bench_fanout.c -I/usr/include/dbus-1.0/ -I/usr/lib64/dbus-1.0/include -ldbus-1 -ljson -lpthread loop.o engine.o commands.o dbus_helpers.o json_utils.o validators.o dbus_json.o agent.o command_ids.o service_table.o atoms.o spsc_ring.o latency.o snapshot.o keys.o cbor.o server.o
+
+# bench_dbus_json
+$CC $FLAGS -o bench_dbus_json bench_dbus_json.c -I/usr/include/dbus-1.0/ -I/usr/lib64/dbus-1.0/include -ldbus-1 -ljson -lncurses dbus_json.o dbus_helpers.o atoms.o
+
+# bench_services_load
+$CC $FLAGS -o bench_services_load bench_services_load.c -I/usr/include/dbus-1.0/ -I/usr/lib64/dbus-1.0/include -ldbus-1 -ljson service_table.o dbus_json.o dbus_helpers.o atoms.o
+
+# test_server
+$CC $FLAGS -o test_server test_server.c -I/usr/include/dbus-1.0/ -I/usr/lib64/dbus-1.0/include -ldbus-1 -ljson -lpthread loop.o engine.o commands.o dbus_helpers.o json_utils.o validators.o dbus_json.o agent.o command_ids.o service_table.o atoms.o spsc_ring.o latency.o snapshot.o keys.o cbor.o server.o
@@ -23,18 +23,41 @@
 
 #include <dbus/dbus.h>
 #include <json/json.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <assert.h>
+#include <unistd.h>
 #include <ncurses.h>
 
 #include "dbus_helpers.h"
+#include "atoms.h"
 
 #include "dbus_json.h"
 
+/*
+ * The json strings of the atoms are shared and their reference count
+ * isn't atomic: a thread decoding next to others makes its own.
+ */
+static __thread bool own_strings;
+
+void __connman_dbus_json_own_strings(bool own)
+{
+	own_strings = own;
+}
+
 struct json_object* dbus_basic_json(DBusMessageIter *iter)
 {
-	int arg_type, i;
+	int arg_type;
 	dbus_bool_t b;
+	unsigned char y;
+	dbus_uint16_t q;
+	dbus_int32_t i;
+	dbus_uint32_t u;
 	double d;
         char *str;
         struct json_object *res;
@@ -43,10 +66,26 @@ struct json_object* dbus_basic_json(DBusMessageIter *iter)
 	arg_type = dbus_message_iter_get_arg_type(iter);
 
 	switch (arg_type) {
-	case DBUS_TYPE_STRING:
+	/*
+	 * paths and short values (State, Type...) come back over and over,
+	 * they share the string of the atom when there is one
+	 */
 	case DBUS_TYPE_OBJECT_PATH:
 		dbus_message_iter_get_basic(iter, &str);
-                res = json_object_new_string(str);
+
+		if (own_strings)
+			res = json_object_new_string(str);
+		else
+			res = __atom_json_lookup(str);
+		break;
+
+	case DBUS_TYPE_STRING:
+		dbus_message_iter_get_basic(iter, &str);
+
+		if (strlen(str) < ATOM_VALUE_MAX_LEN && !own_strings)
+			res = __atom_json_lookup(str);
+		else
+			res = json_object_new_string(str);
 		break;
 
 	case DBUS_TYPE_VARIANT:
@@ -62,14 +101,27 @@ struct json_object* dbus_basic_json(DBusMessageIter *iter)
                         res = json_object_new_boolean(1);
 		break;
 
+	// dbus_message_iter_get_basic only writes the size of the type
 	case DBUS_TYPE_BYTE:
-	case DBUS_TYPE_INT32:
+		dbus_message_iter_get_basic(iter, &y);
+		res = json_object_new_int((int32_t) y);
+		break;
+
 	case DBUS_TYPE_UINT16:
-	case DBUS_TYPE_UINT32:
+		dbus_message_iter_get_basic(iter, &q);
+		res = json_object_new_int((int32_t) q);
+		break;
+
+	case DBUS_TYPE_INT32:
 		dbus_message_iter_get_basic(iter, &i);
                 res = json_object_new_int((int32_t) i);
 		break;
 
+	case DBUS_TYPE_UINT32:
+		dbus_message_iter_get_basic(iter, &u);
+		res = json_object_new_int64((int64_t) u);
+		break;
+
 	case DBUS_TYPE_DOUBLE:
 		dbus_message_iter_get_basic(iter, &d);
 		res = json_object_new_double((double) d);
@@ -104,7 +156,11 @@ struct json_object* dbus_dict_json(DBusMessageIter *iter)
                         dbus_message_iter_next(&entry);
                         dbus_message_iter_recurse(&entry, &subentry);
                         tmp = dbus_to_json(&subentry);
-                        json_object_object_add(dict, str, tmp);
+                        if (own_strings)
+                                json_object_object_add(dict, str, tmp);
+                        else
+                                __atom_object_add(dict, __atom_intern(str),
+                                                tmp);
                         break;
 
                 default:
@@ -195,6 +251,348 @@ struct json_object* __connman_dbus_to_json(DBusMessageIter *iter)
         return (res == NULL ? tmp : res);
 }
 
+/*
+ * The shapes ConnMan sends all the time have a decoder written for them:
+ * the types are known, only the values are read. They give the same json
+ * as __connman_dbus_to_json.
+ */
+
+// the value of a variant
+static struct json_object* decode_value(DBusMessageIter *iter)
+{
+	switch (dbus_message_iter_get_arg_type(iter)) {
+	case DBUS_TYPE_ARRAY:
+	case DBUS_TYPE_STRUCT:
+		return dbus_to_json(iter);
+
+	default:
+		return dbus_basic_json(iter);
+	}
+}
+
+// a{sv}, an empty one is an empty array like dbus_to_json gives
+static struct json_object* decode_dict(DBusMessageIter *iter)
+{
+	DBusMessageIter array, entry, value;
+	struct json_object *dict;
+	const char *key;
+
+	dbus_message_iter_recurse(iter, &array);
+
+	if (dbus_message_iter_get_arg_type(&array) != DBUS_TYPE_DICT_ENTRY)
+		return json_object_new_array();
+
+	dict = json_object_new_object();
+
+	do {
+		dbus_message_iter_recurse(&array, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &value);
+		__atom_object_add(dict, __atom_intern(key),
+				decode_value(&value));
+	} while (dbus_message_iter_next(&array));
+
+	return dict;
+}
+
+// oa{sv}, [ "/net/connman/service/...", { dict } ]
+static struct json_object* decode_object(DBusMessageIter *iter)
+{
+	struct json_object *res = json_object_new_array();
+	const char *path;
+
+	dbus_message_iter_get_basic(iter, &path);
+	json_object_array_add(res, __atom_json_lookup(path));
+	dbus_message_iter_next(iter);
+	json_object_array_add(res, decode_dict(iter));
+
+	return res;
+}
+
+// a(oa{sv}), GetServices and GetTechnologies
+static struct json_object* decode_objects(DBusMessageIter *iter)
+{
+	struct json_object *res = json_object_new_array();
+	DBusMessageIter array, object;
+
+	dbus_message_iter_recurse(iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRUCT) {
+		dbus_message_iter_recurse(&array, &object);
+		json_object_array_add(res, decode_object(&object));
+		dbus_message_iter_next(&array);
+	}
+
+	return res;
+}
+
+// a(oa{sv})ao, ServicesChanged
+static struct json_object* decode_services_changed(DBusMessageIter *iter)
+{
+	struct json_object *res = json_object_new_array(), *removed;
+	DBusMessageIter array;
+	const char *path;
+
+	json_object_array_add(res, decode_objects(iter));
+	dbus_message_iter_next(iter);
+
+	removed = json_object_new_array();
+	dbus_message_iter_recurse(iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) ==
+			DBUS_TYPE_OBJECT_PATH) {
+		dbus_message_iter_get_basic(&array, &path);
+		json_object_array_add(removed, __atom_json_lookup(path));
+		dbus_message_iter_next(&array);
+	}
+
+	json_object_array_add(res, removed);
+
+	return res;
+}
+
+// sv, PropertyChanged
+static struct json_object* decode_property(DBusMessageIter *iter)
+{
+	struct json_object *res = json_object_new_array();
+	DBusMessageIter value;
+
+	json_object_array_add(res, dbus_basic_json(iter));
+	dbus_message_iter_next(iter);
+	dbus_message_iter_recurse(iter, &value);
+	json_object_array_add(res, decode_value(&value));
+
+	return res;
+}
+
+typedef struct json_object* (*dbus_json_decoder_t)(DBusMessageIter *iter);
+
+static const struct {
+	const char *signature;
+	dbus_json_decoder_t decode;
+} decoders[] = {
+	{ "a(oa{sv})", decode_objects },
+	{ "a(oa{sv})ao", decode_services_changed },
+	{ "sv", decode_property },
+	{ "a{sv}", decode_dict },		// GetProperties
+	{ "oa{sv}", decode_object },		// TechnologyAdded
+	{ NULL, },
+};
+
+/*
+ * signature -> decoder, __connman_dbus_to_json for the other signatures.
+ * Each thread decoding messages (see engine_thread_start) has its own.
+ */
+#define DECODER_CACHE_SIZE 16
+#define DECODER_SIGNATURE_MAX 32
+
+static __thread struct {
+	char signature[DECODER_SIGNATURE_MAX];
+	dbus_json_decoder_t decode;	// NULL: an empty slot
+} decoder_cache[DECODER_CACHE_SIZE];
+
+static dbus_json_decoder_t decoder_find(const char *signature)
+{
+	int i;
+
+	for (i = 0; decoders[i].signature; i++)
+		if (strcmp(decoders[i].signature, signature) == 0)
+			return decoders[i].decode;
+
+	return __connman_dbus_to_json;
+}
+
+static dbus_json_decoder_t decoder_lookup(const char *signature)
+{
+	uint32_t hash = 2166136261u;
+	unsigned int slot, i;
+	const char *c;
+
+	for (c = signature; *c; c++) {
+		hash ^= (unsigned char) *c;
+		hash *= 16777619u;
+	}
+
+	for (i = 0; i < DECODER_CACHE_SIZE; i++) {
+		slot = (hash + i) & (DECODER_CACHE_SIZE - 1);
+
+		if (!decoder_cache[slot].decode)
+			break;
+
+		if (strcmp(decoder_cache[slot].signature, signature) == 0)
+			return decoder_cache[slot].decode;
+	}
+
+	// the cache is full or the signature too long: not cached
+	if (i == DECODER_CACHE_SIZE || c - signature >= DECODER_SIGNATURE_MAX)
+		return decoder_find(signature);
+
+	strcpy(decoder_cache[slot].signature, signature);
+	decoder_cache[slot].decode = decoder_find(signature);
+
+	return decoder_cache[slot].decode;
+}
+
+/*
+ * The arguments of a signal, decoded for their signature. Same json as
+ * __connman_dbus_to_json.
+ */
+struct json_object* __connman_dbus_message_to_json(DBusMessage *message)
+{
+	DBusMessageIter iter;
+
+	if (!dbus_message_iter_init(message, &iter))
+		return NULL;
+
+	return decoder_lookup(dbus_message_get_signature(message))(&iter);
+}
+
+/*
+ * The value of a property read with __connman_dbus_objects_foreach, copied
+ * to be kept.
+ */
+struct json_object* __connman_dbus_value_to_json(DBusMessageIter *value)
+{
+	return decode_value(value);
+}
+
+// count (oa{sv}) from the one of array on
+static void objects_walk(DBusMessageIter *array, unsigned int count,
+		dbus_json_object_func_t object_func,
+		dbus_json_property_func_t property_func, void *user_data)
+{
+	DBusMessageIter object, dict, entry, value;
+	const char *path, *key;
+
+	for (; count && dbus_message_iter_get_arg_type(array) ==
+			DBUS_TYPE_STRUCT;
+			count--, dbus_message_iter_next(array)) {
+		dbus_message_iter_recurse(array, &object);
+
+		if (dbus_message_iter_get_arg_type(&object) !=
+				DBUS_TYPE_OBJECT_PATH)
+			continue;
+
+		dbus_message_iter_get_basic(&object, &path);
+		dbus_message_iter_next(&object);
+		object_func(path, user_data);
+
+		if (dbus_message_iter_get_arg_type(&object) != DBUS_TYPE_ARRAY)
+			continue;
+
+		dbus_message_iter_recurse(&object, &dict);
+
+		for (; dbus_message_iter_get_arg_type(&dict) ==
+				DBUS_TYPE_DICT_ENTRY;
+				dbus_message_iter_next(&dict)) {
+			dbus_message_iter_recurse(&dict, &entry);
+			dbus_message_iter_get_basic(&entry, &key);
+			dbus_message_iter_next(&entry);
+			dbus_message_iter_recurse(&entry, &value);
+			property_func(key, &value, user_data);
+		}
+	}
+}
+
+/*
+ * Borrowed decoding of a(oa{sv}) (GetServices): the paths, the keys and
+ * the values given to the callbacks point into the message, they are valid
+ * during the call only. Nothing is copied or allocated: the callbacks copy
+ * what they keep. -EINVAL if iter isn't an a(oa{sv}).
+ */
+int __connman_dbus_objects_foreach(DBusMessageIter *iter,
+		dbus_json_object_func_t object_func,
+		dbus_json_property_func_t property_func, void *user_data)
+{
+	DBusMessageIter array;
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY ||
+			dbus_message_iter_get_element_type(iter) !=
+			DBUS_TYPE_STRUCT)
+		return -EINVAL;
+
+	dbus_message_iter_recurse(iter, &array);
+	objects_walk(&array, UINT_MAX, object_func, property_func, user_data);
+
+	return 0;
+}
+
+/*
+ * Splits the a(oa{sv}) of iter in at most nb_chunks parts of the same size,
+ * of min_count objects at least, to be walked by different threads with
+ * __connman_dbus_objects_chunk_foreach. The number of chunks, 0 if there
+ * are no objects, -EINVAL if iter isn't an a(oa{sv}).
+ */
+int __connman_dbus_objects_split(DBusMessageIter *iter,
+		struct dbus_objects_chunk *chunks, unsigned int nb_chunks,
+		unsigned int min_count)
+{
+	unsigned int count = 0, i, j;
+	DBusMessageIter array, probe;
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY ||
+			dbus_message_iter_get_element_type(iter) !=
+			DBUS_TYPE_STRUCT)
+		return -EINVAL;
+
+	dbus_message_iter_recurse(iter, &array);
+
+	for (probe = array; dbus_message_iter_get_arg_type(&probe) ==
+			DBUS_TYPE_STRUCT; dbus_message_iter_next(&probe))
+		count++;
+
+	if (min_count && nb_chunks > count / min_count)
+		nb_chunks = count / min_count;
+
+	if (nb_chunks > count)
+		nb_chunks = count;
+
+	if (!nb_chunks && count)
+		nb_chunks = 1;
+
+	for (i = 0; i < nb_chunks; i++) {
+		chunks[i].first = array;
+		chunks[i].count = count / nb_chunks +
+			(i < count % nb_chunks ? 1 : 0);
+
+		for (j = 0; j < chunks[i].count; j++)
+			dbus_message_iter_next(&array);
+	}
+
+	return nb_chunks;
+}
+
+void __connman_dbus_objects_chunk_foreach(struct dbus_objects_chunk *chunk,
+		dbus_json_object_func_t object_func,
+		dbus_json_property_func_t property_func, void *user_data)
+{
+	DBusMessageIter array = chunk->first;
+
+	objects_walk(&array, chunk->count, object_func, property_func,
+			user_data);
+}
+
+/*
+ * The same for the iter of a method reply, at its first argument.
+ */
+struct json_object* __connman_dbus_reply_to_json(DBusMessageIter *iter)
+{
+	struct json_object *res;
+	char *signature;
+
+	if (dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_INVALID ||
+			dbus_message_iter_has_next(iter))
+		return __connman_dbus_to_json(iter);
+
+	// with a single argument, it is the signature of the reply
+	signature = dbus_message_iter_get_signature(iter);
+	res = decoder_lookup(signature)(iter);
+	dbus_free(signature);
+
+	return res;
+}
+
 void __connman_dbus_json_print(struct json_object *jobj)
 {
         fprintf(stdout, "\n%s\n", json_object_to_json_string(jobj));
@@ -206,6 +604,328 @@ void __connman_dbus_json_print_pretty(struct json_object *jobj)
 	JSON_C_TO_STRING_PRETTY));
 }
 
+/*
+ * The text of __connman_dbus_to_json written while the message is read,
+ * without building the json objects: in writer->data, or to writer->fd
+ * by chunks of DBUS_JSON_WRITER_CHUNK. The memory used is the size of the
+ * text, or of a chunk. The layout is the one of json_object_to_json_string:
+ 	{ "key": [ 1, "str" ], "other": { } }
+ */
+void __connman_dbus_json_writer_init(struct dbus_json_writer *writer, int fd)
+{
+	writer->data = NULL;
+	writer->len = 0;
+	writer->size = 0;
+	writer->fd = fd;
+	writer->error = 0;
+}
+
+void __connman_dbus_json_writer_free(struct dbus_json_writer *writer)
+{
+	free(writer->data);
+	__connman_dbus_json_writer_init(writer, writer->fd);
+}
+
+int __connman_dbus_json_flush(struct dbus_json_writer *writer)
+{
+	size_t done = 0;
+	ssize_t res;
+
+	if (writer->fd < 0)
+		return 0;
+
+	// after an error, the text is dropped
+	while (!writer->error && done < writer->len) {
+		res = write(writer->fd, writer->data + done,
+				writer->len - done);
+
+		if (res < 0 && errno == EINTR)
+			continue;
+
+		if (res < 0) {
+			writer->error = -errno;
+			break;
+		}
+
+		done += res;
+	}
+
+	writer->len = 0;
+
+	return writer->error;
+}
+
+static void writer_put(struct dbus_json_writer *writer, const char *str,
+		size_t len)
+{
+	size_t size;
+
+	if (writer->fd >= 0 && writer->len + len > DBUS_JSON_WRITER_CHUNK)
+		__connman_dbus_json_flush(writer);
+
+	if (writer->len + len + 1 > writer->size) {
+		size = writer->size ? writer->size * 2 : 256;
+
+		while (size < writer->len + len + 1)
+			size *= 2;
+
+		writer->data = realloc(writer->data, size);
+		assert(writer->data != NULL);
+		writer->size = size;
+	}
+
+	memcpy(writer->data + writer->len, str, len);
+	writer->len += len;
+	writer->data[writer->len] = '\0';
+}
+
+#define writer_str(writer, str) writer_put(writer, str, strlen(str))
+
+// escaped like json-c does
+static void writer_string(struct dbus_json_writer *writer, const char *str)
+{
+	const char *start;
+	char tmp[8];
+
+	writer_put(writer, "\"", 1);
+
+	while (*str) {
+		for (start = str; *str && (unsigned char) *str >= 0x20 &&
+				*str != '"' && *str != '\\' && *str != '/';
+				str++);
+
+		writer_put(writer, start, str - start);
+
+		switch (*str) {
+		case '\0':
+			continue;
+
+		case '"':
+			writer_str(writer, "\\\"");
+			break;
+
+		case '\\':
+			writer_str(writer, "\\\\");
+			break;
+
+		case '/':
+			writer_str(writer, "\\/");
+			break;
+
+		case '\b':
+			writer_str(writer, "\\b");
+			break;
+
+		case '\f':
+			writer_str(writer, "\\f");
+			break;
+
+		case '\n':
+			writer_str(writer, "\\n");
+			break;
+
+		case '\r':
+			writer_str(writer, "\\r");
+			break;
+
+		case '\t':
+			writer_str(writer, "\\t");
+			break;
+
+		default:
+			snprintf(tmp, sizeof(tmp), "\\u%04x", *str);
+			writer_str(writer, tmp);
+			break;
+		}
+
+		str++;
+	}
+
+	writer_put(writer, "\"", 1);
+}
+
+static void write_value(struct dbus_json_writer *writer,
+		DBusMessageIter *iter);
+
+// the elements from iter on, like dbus_array_json
+static void write_array(struct dbus_json_writer *writer,
+		DBusMessageIter *iter)
+{
+	bool first = true;
+
+	writer_put(writer, "[", 1);
+
+	for (; dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_INVALID;
+			dbus_message_iter_next(iter)) {
+		writer_str(writer, first ? " " : ", ");
+		write_value(writer, iter);
+		first = false;
+	}
+
+	writer_str(writer, " ]");
+}
+
+// the dict entries from iter on, like dbus_dict_json
+static void write_dict(struct dbus_json_writer *writer,
+		DBusMessageIter *iter)
+{
+	DBusMessageIter entry, value;
+	bool first = true;
+	const char *key;
+
+	writer_put(writer, "{", 1);
+
+	for (; dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_DICT_ENTRY;
+			dbus_message_iter_next(iter)) {
+		dbus_message_iter_recurse(iter, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+
+		writer_str(writer, first ? " " : ", ");
+		writer_string(writer, key);
+		writer_str(writer, ": ");
+
+		if (dbus_message_iter_get_arg_type(&entry) ==
+				DBUS_TYPE_VARIANT) {
+			dbus_message_iter_recurse(&entry, &value);
+			write_value(writer, &value);
+		} else
+			write_value(writer, &entry);
+
+		first = false;
+	}
+
+	writer_str(writer, " }");
+}
+
+static void write_value(struct dbus_json_writer *writer,
+		DBusMessageIter *iter)
+{
+	DBusMessageIter sub;
+	const char *str;
+	char tmp[32];
+	dbus_bool_t b;
+	unsigned char y;
+	dbus_uint16_t q;
+	dbus_int32_t i;
+	dbus_uint32_t u;
+	double d;
+	int arg_type;
+
+	switch ((arg_type = dbus_message_iter_get_arg_type(iter))) {
+	case DBUS_TYPE_STRUCT:
+		dbus_message_iter_recurse(iter, &sub);
+		write_array(writer, &sub);
+		return;
+
+	case DBUS_TYPE_ARRAY:
+		dbus_message_iter_recurse(iter, &sub);
+
+		if (dbus_message_iter_get_arg_type(&sub) ==
+				DBUS_TYPE_DICT_ENTRY)
+			write_dict(writer, &sub);
+		else
+			write_array(writer, &sub);
+		return;
+
+	case DBUS_TYPE_VARIANT:
+		dbus_message_iter_recurse(iter, &sub);
+		write_value(writer, &sub);
+		return;
+
+	case DBUS_TYPE_STRING:
+	case DBUS_TYPE_OBJECT_PATH:
+		dbus_message_iter_get_basic(iter, &str);
+		writer_string(writer, str);
+		return;
+
+	case DBUS_TYPE_BOOLEAN:
+		dbus_message_iter_get_basic(iter, &b);
+		writer_str(writer, b ? "true" : "false");
+		return;
+
+	// dbus_message_iter_get_basic only writes the size of the type
+	case DBUS_TYPE_BYTE:
+		dbus_message_iter_get_basic(iter, &y);
+		snprintf(tmp, sizeof(tmp), "%u", (unsigned int) y);
+		break;
+
+	case DBUS_TYPE_UINT16:
+		dbus_message_iter_get_basic(iter, &q);
+		snprintf(tmp, sizeof(tmp), "%u", (unsigned int) q);
+		break;
+
+	case DBUS_TYPE_INT32:
+		dbus_message_iter_get_basic(iter, &i);
+		snprintf(tmp, sizeof(tmp), "%d", (int) i);
+		break;
+
+	case DBUS_TYPE_UINT32:
+		dbus_message_iter_get_basic(iter, &u);
+		snprintf(tmp, sizeof(tmp), "%lu", (unsigned long) u);
+		break;
+
+	case DBUS_TYPE_DOUBLE:
+		dbus_message_iter_get_basic(iter, &d);
+		snprintf(tmp, sizeof(tmp), "%.17g", d);
+		break;
+
+	case DBUS_TYPE_INVALID:
+		writer_str(writer, "null");
+		return;
+
+	default:
+		fprintf(stderr, "Type not supported in write_value %d(%c)\n",
+				arg_type, (char) arg_type);
+		writer_str(writer, "null");
+		return;
+	}
+
+	writer_str(writer, tmp);
+}
+
+/*
+ * The arguments from iter on, like __connman_dbus_to_json. The text is
+ * appended to writer->data, or flushed to writer->fd: 0 or -errno of the
+ * write.
+ */
+int __connman_dbus_json_write(struct dbus_json_writer *writer,
+		DBusMessageIter *iter)
+{
+	DBusMessageIter next = *iter;
+
+	if (dbus_message_iter_next(&next) == TRUE) {
+		writer_str(writer, "[ ");
+		write_value(writer, iter);
+		writer_str(writer, ", ");
+		write_value(writer, &next);
+		writer_str(writer, " ]");
+	} else
+		write_value(writer, iter);
+
+	return __connman_dbus_json_flush(writer);
+}
+
+/*
+ * __connman_dbus_json_print of a message, streamed to stdout: nothing is
+ * built in memory, for the big replies (GetServices...).
+ */
+int __connman_dbus_json_print_iter(DBusMessageIter *iter)
+{
+	struct dbus_json_writer writer;
+	int res;
+
+	fflush(stdout);
+	__connman_dbus_json_writer_init(&writer, fileno(stdout));
+	writer_put(&writer, "\n", 1);
+	__connman_dbus_json_write(&writer, iter);
+	writer_put(&writer, "\n", 1);
+	res = __connman_dbus_json_flush(&writer);
+	__connman_dbus_json_writer_free(&writer);
+
+	return res;
+}
+
 int __connman_json_to_dbus_dict(struct json_object *jobj,
 			DBusMessageIter *dict)
 {
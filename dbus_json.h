@@ -20,6 +20,8 @@
 #ifndef __CONNMAN_DBUS_JSON_H
 #define __CONNMAN_DBUS_JSON_H
 
+#include <stdbool.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,10 +36,62 @@ struct json_object* dbus_to_json(DBusMessageIter *iter);
 
 struct json_object* __connman_dbus_to_json(DBusMessageIter *iter);
 
+struct json_object* __connman_dbus_message_to_json(DBusMessage *message);
+
+struct json_object* __connman_dbus_reply_to_json(DBusMessageIter *iter);
+
+typedef void (*dbus_json_object_func_t)(const char *path, void *user_data);
+
+typedef void (*dbus_json_property_func_t)(const char *key,
+		DBusMessageIter *value, void *user_data);
+
+int __connman_dbus_objects_foreach(DBusMessageIter *iter,
+		dbus_json_object_func_t object_func,
+		dbus_json_property_func_t property_func, void *user_data);
+
+struct json_object* __connman_dbus_value_to_json(DBusMessageIter *value);
+
+struct dbus_objects_chunk {
+	DBusMessageIter first;
+	unsigned int count;
+};
+
+int __connman_dbus_objects_split(DBusMessageIter *iter,
+		struct dbus_objects_chunk *chunks, unsigned int nb_chunks,
+		unsigned int min_count);
+
+void __connman_dbus_objects_chunk_foreach(struct dbus_objects_chunk *chunk,
+		dbus_json_object_func_t object_func,
+		dbus_json_property_func_t property_func, void *user_data);
+
+void __connman_dbus_json_own_strings(bool own);
+
 void __connman_dbus_json_print(struct json_object *jobj);
 
 void __connman_dbus_json_print_pretty(struct json_object *jobj);
 
+#define DBUS_JSON_WRITER_CHUNK 65536
+
+struct dbus_json_writer {
+	char *data;
+	size_t len;
+	size_t size;
+	int fd;			// -1 to keep the text in data
+	int error;		// -errno of the first failed write
+};
+
+void __connman_dbus_json_writer_init(struct dbus_json_writer *writer,
+		int fd);
+
+void __connman_dbus_json_writer_free(struct dbus_json_writer *writer);
+
+int __connman_dbus_json_flush(struct dbus_json_writer *writer);
+
+int __connman_dbus_json_write(struct dbus_json_writer *writer,
+		DBusMessageIter *iter);
+
+int __connman_dbus_json_print_iter(DBusMessageIter *iter);
+
 int __connman_json_to_dbus_dict(struct json_object *jobj,
 		DBusMessageIter *dict);
 
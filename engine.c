@@ -27,21 +27,49 @@
 #include <assert.h>
 #include <stdio.h>
 #include <ncurses.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "commands.h"
 #include "json_utils.h"
 #include "loop.h"
 #include "dbus_json.h"
 #include "keys.h"
+#include "service_table.h"
+#include "atoms.h"
+#include "snapshot.h"
+#include "command_ids.h"
+#include "spsc_ring.h"
+#include "latency.h"
 
 #include "engine.h"
 
 DBusConnection *connection;
 
 void (*engine_callback)(int status, struct json_object *jobj) = NULL;
+unsigned int engine_decode_workers;
 
-/* state for the initialisation */
-static enum {INIT_STATE, INIT_TECHNOLOGIES, INIT_SERVICES, INIT_OVER} init_status = INIT_STATE;
+/* the dbus thread runs, see engine_thread_start */
+static bool threaded;
+
+/* replies engine_init is still waiting for, and the first error */
+static int init_pending;
+static int init_error;
+
+/*
+ * When the cache was loaded from the snapshot, engine_init doesn't wait for
+ * the replies: they are reconciled with the cache as they come.
+ */
+static bool init_from_snapshot;
+static int init_changes;
+
+/* the cache changed since the snapshot was written */
+static bool snapshot_dirty;
 
 /* the recorded state as given by connman-json */
 static struct json_object *state;
@@ -49,8 +77,16 @@ static struct json_object *state;
 /* the recorded technologies as given by connman-json */
 static struct json_object *technologies;
 
-/* the recorded services as given by connman-json */
-static struct json_object *services;
+/* the recorded services as given by connman-json, see service_table.h */
+static struct service_table *services;
+
+/*
+ * Index of technologies by dbus name:
+ * dbus_name -> [ dbus_name, { dict } ]
+ * The values are the very same sub arrays stored in technologies,
+ * json-c hashes the keys so a lookup doesn't scan the whole array.
+ */
+static struct json_object *technologies_index;
 
 
 static void react_to_sig_service(struct json_object *interface,
@@ -74,80 +110,212 @@ static struct {
 	{ true, react_to_sig_manager },		// Manager
 };
 
+static void index_add(struct json_object *index, struct json_object *sub_array)
+{
+	const char *name;
+
+	name = json_object_get_string(json_object_array_get_idx(sub_array, 0));
+
+	if (name)
+		json_object_object_add(index, name, json_object_get(sub_array));
+}
+
+/*
+ * Build the index of a technologies array, the previous index (if any) is
+ * released.
+ */
+static struct json_object *index_build(struct json_object *index,
+		struct json_object *ressource)
+{
+	int len, i;
+
+	json_object_put(index);
+	index = json_object_new_object();
+	len = json_object_array_length(ressource);
+
+	for (i = 0; i < len; i++)
+		index_add(index, json_object_array_get_idx(ressource, i));
+
+	return index;
+}
+
+/*
+ * engine_callback, timed. In threaded mode it only queues the event for the
+ * ui thread: thread_events_ready times the ui callback instead.
+ */
+static void ui_notify(int status, struct json_object *jobj)
+{
+	uint64_t start;
+
+	if (threaded) {
+		engine_callback(status, jobj);
+		return;
+	}
+
+	start = __latency_now();
+	engine_callback(status, jobj);
+	__latency_record(LATENCY_CALLBACK, start);
+}
+
 static void engine_commands_cb(struct json_object *data, json_bool is_error)
 {
-	switch (init_status) {
-		case INIT_STATE:
-			state = data;
-			break;
-		
-		case INIT_TECHNOLOGIES:
-			technologies = data;
-			break;
+	if (data)
+		ui_notify((is_error ? 1 : 0), data);
+}
 
-		case INIT_SERVICES:
-			services = data;
-			break;
+/*
+ * One query in flight, from engine_query_full to its reply. It is the
+ * user_data of the dbus call, so the queries complete in any order.
+ */
+struct engine_request {
+	unsigned int id;
+	engine_reply_func_t cb;		// NULL: engine_callback
+	void *user_data;
+	struct engine_batch *batch;	// the batch of the command, if any
+	unsigned int index;		// in the batch
+};
 
-		default:
-			if (data)
-				engine_callback((is_error ? 1 : 0), data);
-			break;
+static void thread_publish_request(struct engine_request *req, int status,
+		struct json_object *jobj);
+
+static void batch_item_done(struct engine_batch *batch, unsigned int index,
+		int status, struct json_object *jobj);
+
+// req is freed
+static void request_complete(struct engine_request *req, int status,
+		struct json_object *jobj)
+{
+	uint64_t start;
+
+	if (req->batch) {
+		batch_item_done(req->batch, req->index, status, jobj);
+		free(req);
+		return;
 	}
 
-	if (init_status != INIT_OVER)
-		loop_quit();
+	if (!req->cb) {
+		if (jobj)
+			ui_notify(status, jobj);
+
+		free(req);
+		return;
+	}
+
+	if (threaded) {
+		thread_publish_request(req, status, jobj);
+		return;
+	}
+
+	start = __latency_now();
+	req->cb(req->id, status, jobj, req->user_data);
+	__latency_record(LATENCY_CALLBACK, start);
+	free(req);
+}
+
+/*
+ * A D-Bus error is status 1 for the ui, -EIO in a batch where every failed
+ * command has a -errno.
+ */
+static void request_reply(struct json_object *data, json_bool is_error,
+		void *user_data)
+{
+	struct engine_request *req = user_data;
+
+	if (is_error && req->batch)
+		request_complete(req, -EIO, data);
+	else
+		request_complete(req, (is_error ? 1 : 0), data);
 }
 
 static void engine_agent_cb(struct json_object *data, struct agent_data *request)
 {
-	engine_callback(-ENOSYS, NULL);
+	ui_notify(-ENOSYS, NULL);
 }
 
 static void engine_agent_error_cb(struct json_object *data)
 {
-	engine_callback(-ENOSYS, NULL);
+	json_object_put(data);
+
+	// the ui doesn't exist yet
+	if (init_pending)
+		return;
+
+	ui_notify(-ENOSYS, NULL);
 }
 
 /*
- * dbus_name in technologies or services
+ * dbus_name in technologies
  * dbus_name -> [ dbus_name, { dict } ]
  */
-static struct json_object *search_technology_or_service(struct json_object *ressource,
+static struct json_object *search_technology_or_service(struct json_object *index,
                                        const char *cmd)
 {
-	int len, i;
-	bool found = false;
-	struct json_object *sub_array, *name;
-	const char *bus_name;
+	struct json_object *sub_array;
+
+	if (!index || !cmd)
+		return NULL;
+
+	if (!json_object_object_get_ex(index, cmd, &sub_array))
+		return NULL;
+
+	return sub_array;
+}
+
+/*
+ * Remove the entries named in names (a json array of dbus names) from the
+ * technologies array and its index. The array is rebuilt since json-c
+ * can't delete an element in place.
+ */
+static struct json_object *remove_technologies(struct json_object *ressource,
+		struct json_object *index, struct json_object *names)
+{
+	struct json_object *sub_array, *tmp_array;
+	const char *name;
+	int i, len, removed = 0;
+
+	len = json_object_array_length(names);
+
+	for (i = 0; i < len; i++) {
+		name = json_object_get_string(json_object_array_get_idx(names, i));
+
+		if (search_technology_or_service(index, name)) {
+			json_object_object_del(index, name);
+			removed++;
+		}
+	}
 
+	if (!removed)
+		return ressource;
+
+	tmp_array = json_object_new_array();
 	len = json_object_array_length(ressource);
 
-	for (i = 0; i < len && !found; i++) {
+	for (i = 0; i < len; i++) {
 		sub_array = json_object_array_get_idx(ressource, i);
-		name = json_object_array_get_idx(sub_array, 0);
-		bus_name = json_object_get_string(name);
+		name = json_object_get_string(json_object_array_get_idx(sub_array, 0));
 
-		if (strncmp(bus_name, cmd, 256) == 0)
-			return sub_array;
+		if (search_technology_or_service(index, name))
+			json_object_array_add(tmp_array, json_object_get(sub_array));
 	}
 
-	return 0;
+	json_object_put(ressource);
+
+	return tmp_array;
 }
 
 static struct json_object *get_technology(const char *cmd)
 {
-	return search_technology_or_service(technologies, cmd);
+	return search_technology_or_service(technologies_index, cmd);
 }
 
-static struct json_object *get_service(const char *cmd)
+static int get_service(const char *cmd)
 {
-	return search_technology_or_service(services, cmd);
+	return __service_table_lookup(services, cmd);
 }
 
 static bool has_service(const char *cmd)
 {
-	return !!get_service(cmd);
+	return get_service(cmd) >= 0;
 }
 
 /*
@@ -169,19 +337,24 @@ static struct json_object* coating(const char *cmd_name,
 	return res;
 }
 
-static int get_state(struct json_object *jobj)
+/*
+ * The commands complete req, once, if they return -EINPROGRESS. Otherwise
+ * req is left to the caller.
+ */
+static int get_state(struct json_object *jobj, struct engine_request *req)
 {
-	return __cmd_state();
+	return __cmd_state(request_reply, req);
 }
 
-static int get_services(struct json_object *jobj)
+static int get_services(struct json_object *jobj, struct engine_request *req)
 {
-	return __cmd_services();
+	return __cmd_services(request_reply, req);
 }
 
-static int get_technologies(struct json_object *jobj)
+static int get_technologies(struct json_object *jobj,
+		struct engine_request *req)
 {
-	return __cmd_technologies();
+	return __cmd_technologies(request_reply, req);
 }
 
 /*
@@ -197,7 +370,7 @@ static int get_technologies(struct json_object *jobj)
 	}
  }
  */
-static int get_home_page(struct json_object *jobj)
+static int get_home_page(struct json_object *jobj, struct engine_request *req)
 {
 	struct json_object *res;
 
@@ -205,7 +378,7 @@ static int get_home_page(struct json_object *jobj)
 	json_object_object_add(res, key_state, json_object_get(state));
 	json_object_object_add(res, key_technologies, json_object_get(technologies));
 
-	engine_callback(0, coating("get_home_page", res));
+	request_complete(req, 0, coating("get_home_page", res));
 
 	// coating increment ref count of res, but creating a new object already
 	// increment the ref count of res
@@ -217,42 +390,39 @@ static int get_home_page(struct json_object *jobj)
 static struct json_object* get_services_matching_tech_type(const char
 		*technology, bool is_connected)
 {
-	struct json_object *array_serv, *serv_dict, *serv_type, *res;
-	struct json_object *serv_state;
-	int len, i;
-	bool is_online, is_ready;
+	struct json_object *res;
+	enum service_type type;
+	unsigned int i;
 
 	res = json_object_new_array();
-	len = json_object_array_length(services);
+	type = __service_type_from_str(technology);
 
-	for (i = 0; i < len; i++) {
-		array_serv = json_object_array_get_idx(services, i);
-		serv_dict = json_object_array_get_idx(array_serv, 1);
-		json_object_object_get_ex(serv_dict, "Type", &serv_type);
-
-		if (strncmp(json_object_get_string(serv_type), technology, 256) == 0) {
-			json_object_object_get_ex(serv_dict, "State", &serv_state);
-
-			is_online = strncmp(json_object_get_string(serv_state),
-					"online", 256) == 0;
-			is_ready = strncmp(json_object_get_string(serv_state),
-					"ready", 256) == 0;
-
-			// Do we look for something we are connected to ?
-			// 	Yes -> is the service online / ready ?
-			//		No -> continue search
-			//		Yes -> remember the service
-			if (is_connected && !(is_online || is_ready))
-				continue;
-
-			json_object_array_add(res, json_object_get(array_serv));
-		}
+	if (type == SERVICE_TYPE_UNKNOWN)
+		return res;
+
+	for (i = 0; i < services->count; i++) {
+		if (!(services->flags[i] & SERVICE_HAS_TYPE) ||
+				services->type[i] != type)
+			continue;
+
+		// Do we look for something we are connected to ?
+		// 	Yes -> is the service online / ready ?
+		//		No -> continue search
+		//		Yes -> remember the service
+		if (is_connected && (!(services->flags[i] &
+						SERVICE_HAS_STATE) ||
+					!__service_state_is_connected(
+						services->state[i])))
+			continue;
+
+		json_object_array_add(res, __service_table_to_json(services, i));
 	}
 
 	return res;
 }
 
-static int get_services_from_tech(struct json_object *jobj)
+static int get_services_from_tech(struct json_object *jobj,
+		struct engine_request *req)
 {
 	struct json_object *tmp, *res, *res_serv, *res_tech, *tech_dict,
 			   *jtech_type, *tech_co;
@@ -277,13 +447,14 @@ static int get_services_from_tech(struct json_object *jobj)
 	res = json_object_new_object();
 	json_object_object_add(res, "services", res_serv);
 	json_object_object_add(res, "technology", res_tech);
-	engine_callback(0, coating("get_services_from_tech", res));
+	request_complete(req, 0, coating("get_services_from_tech", res));
 	json_object_put(res);
 
 	return -EINPROGRESS;
 }
 
-static int connect_to_service(struct json_object *jobj)
+static int connect_to_service(struct json_object *jobj,
+		struct engine_request *req)
 {
 	struct json_object *tmp;
 	const char *serv_dbus_name;
@@ -294,61 +465,334 @@ static int connect_to_service(struct json_object *jobj)
 	if (!has_service(serv_dbus_name))
 		return -EINVAL;
 	
-	return __cmd_connect_full_name(serv_dbus_name);
+	return __cmd_connect_full_name(serv_dbus_name, request_reply, req);
+}
+
+/*
+ {
+ 	"command": "get_atoms_stats",
+	"cmd_data": {
+		"atoms": 1234,
+		"bytes": 56789,
+		"lookups": 123456,
+		"hits": 122222,
+		"bytes_saved": 4567890
+	}
+ }
+ */
+static int get_atoms_stats(struct json_object *jobj, struct engine_request *req)
+{
+	struct json_object *res = __atoms_stats_json();
+
+	request_complete(req, 0, coating("get_atoms_stats", res));
+	json_object_put(res);
+
+	return -EINPROGRESS;
 }
 
+/*
+ * The counters of the loop dispatching dbus (the dbus thread in threaded
+ * mode).
+ {
+	"command": "get_loop_stats",
+	"cmd_data": {
+		"iterations": 1234,
+		"dispatched": 56789,
+		"budget_hits": 12,
+		"time_budget_hits": 3
+	}
+ }
+ */
+static int get_loop_stats(struct json_object *jobj, struct engine_request *req)
+{
+	struct json_object *res = json_object_new_object();
+	struct loop_stats stats;
+
+	loop_get_stats(&stats);
+	json_object_object_add(res, "iterations",
+			json_object_new_int64(stats.iterations));
+	json_object_object_add(res, "dispatched",
+			json_object_new_int64(stats.dispatched));
+	json_object_object_add(res, "budget_hits",
+			json_object_new_int64(stats.budget_hits));
+	json_object_object_add(res, "time_budget_hits",
+			json_object_new_int64(stats.time_budget_hits));
+
+	request_complete(req, 0, coating("get_loop_stats", res));
+	json_object_put(res);
+
+	return -EINPROGRESS;
+}
+
+/*
+ * The latency histograms (see latency.h), in ns. SIGUSR1 dumps them too
+ * (see latency_dump_path).
+ {
+	"command": "get_latency",
+	"cmd_data": {
+		"wake_to_watch": {
+			"count": 1234,
+			"mean": 5678,
+			"p50": 4100,
+			"p90": 9200,
+			"p99": 31000,
+			"p999": 120000,
+			"max": 250123
+		},
+		"dispatch": { ... },
+		"signal": { ... },
+		"callback": { ... },
+		"input": { ... }
+	}
+ }
+ */
+static int get_latency(struct json_object *jobj, struct engine_request *req)
+{
+	struct json_object *res = __latency_json();
+
+	request_complete(req, 0, coating("get_latency", res));
+	json_object_put(res);
+
+	return -EINPROGRESS;
+}
+
+static int batch(struct json_object *jobj, struct engine_request *req);
+
+/*
+ * The commands of engine_query, indexed by their id (see command_ids.h).
+ * The other commands have no func.
+ */
 static const struct {
-	const char *cmd;
-	int (*func)(struct json_object *jobj);
+	int (*func)(struct json_object *jobj, struct engine_request *req);
 	bool trusted_is_json_string;
 	union {
 		const char *trusted_str;
 		struct json_object *trusted_jobj;
 	} trusted;
-} cmd_table[] = {
-	{ "get_state", get_state, true, { "" } },
-	{ "get_services", get_services, true, { "" } },
-	{ "get_technologies", get_technologies, true, { "" } },
-	{ "get_home_page", get_home_page, true, { "" } },
-	{ "get_services_from_tech", get_services_from_tech, true, {
-	"{ \"technology\": \"(%5C%5C|/|([a-zA-Z]))+\" }" } },
-	{ "connect", connect_to_service, true, {
-	"{ \"service\": \"(%5C%5C|/|([a-zA-Z]))+\" }" } },
-	{ NULL, }, // this is a sentinel
+} cmd_table[CMD_UNKNOWN] = {
+	[CMD_GET_STATE] = { get_state, true, { "" } },
+	[CMD_GET_SERVICES] = { get_services, true, { "" } },
+	[CMD_GET_TECHNOLOGIES] = { get_technologies, true, { "" } },
+	[CMD_GET_HOME_PAGE] = { get_home_page, true, { "" } },
+	[CMD_GET_SERVICES_FROM_TECH] = { get_services_from_tech, true, {
+	"{ \"technology\": \"@dbus_path\" }" } },
+	[CMD_CONNECT] = { connect_to_service, true, {
+	"{ \"service\": \"@dbus_path\" }" } },
+	[CMD_GET_ATOMS_STATS] = { get_atoms_stats, true, { "" } },
+	[CMD_GET_LOOP_STATS] = { get_loop_stats, true, { "" } },
+	[CMD_GET_LATENCY] = { get_latency, true, { "" } },
+	// its commands are checked by batch_is_clean
+	[CMD_BATCH] = { batch, true, { "" } },
 };
 
-static int command_exist(const char *cmd)
+/* the trusted json of cmd_table, compiled once by engine_init */
+static struct json_validator *cmd_validators[CMD_UNKNOWN];
+
+static void validators_compile(void)
 {
-	int res = -1, i;
+	struct json_object *jtrusted;
+	int i;
+
+	for (i = 0; i < CMD_UNKNOWN; i++) {
+		if (!cmd_table[i].func)
+			continue;
+
+		if (cmd_table[i].trusted_is_json_string)
+			jtrusted = json_tokener_parse(
+					cmd_table[i].trusted.trusted_str);
+		else
+			jtrusted = json_object_get(
+					cmd_table[i].trusted.trusted_jobj);
+
+		// NULL for the commands that don't take data
+		cmd_validators[i] = __json_validator_compile(jtrusted);
+		json_object_put(jtrusted);
+	}
+}
 
-	for (i = 0; ; i++) {
+static void validators_free(void)
+{
+	int i;
 
-		if (cmd_table[i].cmd == NULL)
-			break;
+	for (i = 0; i < CMD_UNKNOWN; i++) {
+		__json_validator_free(cmd_validators[i]);
+		cmd_validators[i] = NULL;
+	}
+}
+
+static bool command_data_is_clean(struct json_object *jobj,
+		enum command_id cmd_id)
+{
+	return __json_validator_match(cmd_validators[cmd_id], jobj);
+}
+
+/*
+ {
+	"ERROR": [ "connect: error -22" ]
+ }
+ */
+static struct json_object* query_error(enum command_id cmd_id, int res)
+{
+	struct json_object *jobj, *array;
+	char msg[64];
+
+	snprintf(msg, sizeof(msg), "%s: error %d", __command_name(cmd_id),
+			res);
+	array = json_object_new_array();
+	json_object_array_add(array, json_object_new_string(msg));
+	jobj = json_object_new_object();
+	json_object_object_add(jobj, key_dbus_json_error_key, array);
+
+	return jobj;
+}
+
+/*
+ * The commands of a batch run at once: their dbus calls are pipelined and
+ * the batch has a single reply, once the last one is answered.
+ */
+#define BATCH_MAX 128
+
+struct engine_batch {
+	struct engine_request *req;
+	struct json_object *results;
+	unsigned int pending;
+};
+
+/*
+ * Every command of the batch is checked before any runs: one bad command
+ * rejects the batch.
+ */
+static bool batch_is_clean(struct json_object *jobj)
+{
+	struct json_object *item, *jitem_data;
+	enum command_id cmd_id;
+	int i, len;
+
+	if (!jobj || json_object_get_type(jobj) != json_type_array)
+		return false;
+
+	len = json_object_array_length(jobj);
+
+	if (len == 0 || len > BATCH_MAX)
+		return false;
+
+	for (i = 0; i < len; i++) {
+		item = json_object_array_get_idx(jobj, i);
+
+		if (json_object_get_type(item) != json_type_object)
+			return false;
+
+		cmd_id = __command_id(__json_get_command_str(item));
+
+		if (cmd_id == CMD_UNKNOWN || cmd_id == CMD_BATCH ||
+				!cmd_table[cmd_id].func)
+			return false;
 
-		if (strncmp(cmd_table[i].cmd, cmd, JSON_COMMANDS_STRING_SIZE_SMALL) == 0)
-			res = i;
+		jitem_data = NULL;
+		json_object_object_get_ex(item, key_command_data,
+				&jitem_data);
+
+		// a command that takes data (connect...) must have it
+		if (jitem_data ? !command_data_is_clean(jitem_data, cmd_id) :
+				cmd_validators[cmd_id] != NULL)
+			return false;
 	}
 
-	return res;
+	return true;
 }
 
-static bool command_data_is_clean(struct json_object *jobj, int cmd_pos)
+static void batch_unref(struct engine_batch *batch)
 {
-	struct json_object *jcmd_data;
-	bool res = false;
+	struct json_object *res;
 
-	if (cmd_table[cmd_pos].trusted_is_json_string)
-		jcmd_data = json_tokener_parse(cmd_table[cmd_pos].trusted.trusted_str);
-	else 
-		jcmd_data = cmd_table[cmd_pos].trusted.trusted_jobj;
+	if (--batch->pending > 0)
+		return;
 
-	assert(jcmd_data);
+	res = coating("batch", batch->results);
+	json_object_put(batch->results);
+	request_complete(batch->req, 0, res);
+	free(batch);
+}
 
-	res = __json_type_dispatch(jobj, jcmd_data);
-	json_object_put(jcmd_data);
+static void batch_item_done(struct engine_batch *batch, unsigned int index,
+		int status, struct json_object *jobj)
+{
+	struct json_object *result;
 
-	return res;
+	result = json_object_array_get_idx(batch->results, index);
+	json_object_object_add(result, "status", json_object_new_int(status));
+	json_object_object_add(result, "data", jobj);
+	batch_unref(batch);
+}
+
+/*
+ * The results are in the order of the commands, whatever the order of the
+ * replies. The status of a command is 0 or a -errno, -EIO when ConnMan
+ * replied with an error.
+ {
+	"command": "batch",
+	"cmd_data": [
+		{
+			"command": "get_state",
+			"status": 0,
+			"data": { ... }
+		},
+		{
+			"command": "connect",
+			"status": -22,
+			"data": { "ERROR": [ "connect: error -22" ] }
+		}
+	]
+ }
+ */
+static int batch(struct json_object *jobj, struct engine_request *req)
+{
+	struct json_object *item, *jitem_data, *result;
+	struct engine_request *item_req;
+	struct engine_batch *batch;
+	enum command_id cmd_id;
+	int i, len, res;
+
+	if (!(batch = malloc(sizeof(struct engine_batch))))
+		return -ENOMEM;
+
+	len = json_object_array_length(jobj);
+	batch->req = req;
+	batch->results = json_object_new_array();
+	// not done before every command is sent
+	batch->pending = len + 1;
+
+	for (i = 0; i < len; i++) {
+		item = json_object_array_get_idx(jobj, i);
+		cmd_id = __command_id(__json_get_command_str(item));
+
+		result = json_object_new_object();
+		json_object_object_add(result, key_command,
+				json_object_new_string(__command_name(cmd_id)));
+		json_object_array_add(batch->results, result);
+
+		if (!(item_req = calloc(1, sizeof(struct engine_request)))) {
+			batch_item_done(batch, i, -ENOMEM,
+					query_error(cmd_id, -ENOMEM));
+			continue;
+		}
+
+		item_req->batch = batch;
+		item_req->index = i;
+		json_object_object_get_ex(item, key_command_data,
+				&jitem_data);
+		res = cmd_table[cmd_id].func(jitem_data, item_req);
+
+		if (res < 0 && res != -EINPROGRESS) {
+			free(item_req);
+			batch_item_done(batch, i, res, query_error(cmd_id,
+						res));
+		}
+	}
+
+	batch_unref(batch);
+
+	return -EINPROGRESS;
 }
 
 /*
@@ -360,7 +804,7 @@ static bool command_data_is_clean(struct json_object *jobj, int cmd_pos)
 	"cmd_data": OBJECT
   }
 */
-static void engine_commands_sig(struct json_object *jobj)
+static void engine_commands_sig(struct json_object *jobj, bool applied)
 {
 	struct json_object *sig_name, *interface, *data, *path;
 	const char *interface_str, *sig_name_str;
@@ -384,10 +828,70 @@ static void engine_commands_sig(struct json_object *jobj)
 	json_object_object_get_ex(jobj, key_dbus_json_signal_key, &sig_name);
 	sig_name_str = json_object_get_string(sig_name);
 
-	subscribed_to[pos].react_to_sig(interface, path, data, sig_name_str);
+	// engine_property_changed has already put it in the service table
+	if (!applied)
+		subscribed_to[pos].react_to_sig(interface, path, data,
+				sig_name_str);
+
+	snapshot_dirty = true;
+
+	if (__atomic_load_n(&subscribed_to[pos].client_subscribed,
+				__ATOMIC_RELAXED))
+		ui_notify(ENGINE_SIGNAL_STATUS, jobj);
+	else
+		json_object_put(jobj);
+}
+
+/*
+ * A Service PropertyChanged of a hot property (Strength, State...) goes
+ * from the message to the service table. When nobody wants the signal
+ * itself, that's all: no json is built, nothing is allocated. When it is
+ * forwarded (the ncurses ui subscribes), false, it is still decoded for
+ * engine_callback but not applied again: *applied is set. The properties
+ * that aren't hot take the usual way, false.
+ */
+static bool engine_property_changed(DBusMessage *message, bool *applied)
+{
+	DBusMessageIter iter, value;
+	const char *key;
+	bool subscribed;
+	int serv;
+
+	if (strcmp(dbus_message_get_signature(message), "sv") != 0)
+		return false;
+
+	subscribed = __atomic_load_n(&subscribed_to[0].client_subscribed,
+			__ATOMIC_RELAXED);
+
+	// the json way would do nothing either
+	if ((serv = get_service(dbus_message_get_path(message))) < 0)
+		return !subscribed;
+
+	dbus_message_iter_init(message, &iter);
+	dbus_message_iter_get_basic(&iter, &key);
+	dbus_message_iter_next(&iter);
+	dbus_message_iter_recurse(&iter, &value);
+
+	if (!__service_table_set_dbus(services, serv, key, &value))
+		return false;
+
+	snapshot_dirty = true;
+	*applied = true;
+
+	return !subscribed;
+}
+
+/*
+ * Whether the signals are given to engine_callback (the default). Without
+ * them the cache is still kept up to date, at a lower cost.
+ */
+void engine_subscribe_signals(bool subscribed)
+{
+	unsigned int i;
 
-	if (subscribed_to[pos].client_subscribed)
-		engine_callback(12345, jobj); // ToDo modify / normalize
+	for (i = 0; i < sizeof(subscribed_to) / sizeof(subscribed_to[0]); i++)
+		__atomic_store_n(&subscribed_to[i].client_subscribed,
+				subscribed, __ATOMIC_RELAXED);
 }
 
 static void react_to_sig_service(struct json_object *interface,
@@ -395,24 +899,21 @@ static void react_to_sig_service(struct json_object *interface,
 			const char *sig_name)
 {
 	char serv_dbus_name[256];
-	struct json_object *serv, *serv_dict, *val;
 	const char *key;
+	int serv;
 
 	snprintf(serv_dbus_name, 256, "/net/connman/service/%s", json_object_get_string(path));
 	serv_dbus_name[255] = '\0';
-	serv = search_technology_or_service(services, serv_dbus_name);
+	serv = get_service(serv_dbus_name);
 
-	if (!serv)
+	if (serv < 0)
 		return;
 
 	key = json_object_get_string(json_object_array_get_idx(data, 0));
-	val = json_object_array_get_idx(data, 1);
-	serv_dict = json_object_array_get_idx(serv, 1);
 
-	if (serv_dict && json_object_object_get_ex(serv_dict, key, NULL)) {
-		json_object_object_del(serv_dict, key);
-		json_object_object_add(serv_dict, key, val);
-	}
+	if (key)
+		__service_table_set_property(services, serv, key,
+				json_object_array_get_idx(data, 1));
 }
 
 static void react_to_sig_technology(struct json_object *interface,
@@ -425,7 +926,7 @@ static void react_to_sig_technology(struct json_object *interface,
 
 	snprintf(tech_dbus_name, 256, "/net/connman/technology/%s", json_object_get_string(path));
 	tech_dbus_name[255] = '\0';
-	tech = search_technology_or_service(technologies, tech_dbus_name);
+	tech = get_technology(tech_dbus_name);
 
 	if (!tech)
 		return;
@@ -434,38 +935,29 @@ static void react_to_sig_technology(struct json_object *interface,
 	val = json_object_array_get_idx(data, 1);
 	tech_dict = json_object_array_get_idx(tech, 1);
 
+	// val belongs to the signal
 	if (tech_dict && json_object_object_get_ex(tech_dict, key, NULL)) {
 		json_object_object_del(tech_dict, key);
-		json_object_object_add(tech_dict, key, val);
+		json_object_object_add(tech_dict, key, json_object_get(val));
 	}
 }
 
-static void replace_service_in_services(const char *serv_name,
-		struct json_object *serv_dict)
+/*
+ * ServicesChanged gives an empty dict for the services that didn't change.
+ */
+static bool dict_has_keys(struct json_object *dict)
 {
-	struct json_object *sub_array, *tmp;
-	int i, len;
-	bool found = false;
-	
-	len = json_object_array_length(services);
-
-	for (i = 0; i < len && !found; i++) {
-		sub_array = json_object_array_get_idx(services, i);
-		tmp = json_object_array_get_idx(sub_array, 0);
+	json_object_object_foreach(dict, key, val)
+		return key && val;
 
-		if (strcmp(json_object_get_string(tmp), serv_name) == 0) {
-			json_object_array_put_idx(sub_array, 1,
-					json_object_get(serv_dict));
-			found = true;
-		}
-	}
+	return false;
+}
 
-	if (!found) {
-		tmp = json_object_new_array();
-		json_object_array_add(tmp, json_object_new_string(serv_name));
-		json_object_array_add(tmp, json_object_get(serv_dict));
-		json_object_array_add(services, tmp);
-	}
+static void replace_service_in_services(const char *serv_name,
+		struct json_object *serv_dict)
+{
+	__service_table_set_dict(services, __service_table_upsert(services,
+				serv_name), serv_dict);
 }
 
 static void react_to_sig_manager(struct json_object *interface,
@@ -474,7 +966,7 @@ static void react_to_sig_manager(struct json_object *interface,
 {
 	const char *tmp_str;
 	struct json_object *serv_to_del, *serv_to_add, *sub_array, *serv_dict,
-			   *tmp, *tmp_array;
+			   *tmp_array;
 	int i, len;
 
 	if (strcmp(sig_name, "ServicesChanged") == 0) {
@@ -482,13 +974,9 @@ static void react_to_sig_manager(struct json_object *interface,
 		serv_to_del = json_object_array_get_idx(data, 1);
 		len = json_object_array_length(serv_to_del);
 
-		for (i = 0; i < len; i++) {
-			tmp_str = json_object_get_string(
-					json_object_array_get_idx(serv_to_del, i));
-
-			if (json_object_object_get_ex(services, tmp_str, NULL))
-				json_object_object_del(services, tmp_str);
-		}
+		for (i = 0; i < len; i++)
+			__service_table_remove(services, json_object_get_string(
+					json_object_array_get_idx(serv_to_del, i)));
 
 		// add new services
 		serv_to_add = json_object_array_get_idx(data, 0);
@@ -499,7 +987,7 @@ static void react_to_sig_manager(struct json_object *interface,
 			serv_dict = json_object_array_get_idx(sub_array, 1);
 
 			// if the service have been "modified"
-			if (json_object_array_length(serv_dict)) {
+			if (dict_has_keys(serv_dict)) {
 				tmp_str = json_object_get_string(
 						json_object_array_get_idx(sub_array, 0));
 				replace_service_in_services(tmp_str, serv_dict);
@@ -517,58 +1005,606 @@ static void react_to_sig_manager(struct json_object *interface,
 		tmp_str = json_object_get_string(json_object_array_get_idx(data,
 					0));
 		json_object_object_del(state, tmp_str);
-		json_object_object_add(state, tmp_str,
-				json_object_array_get_idx(data, 1));
+		json_object_object_add(state, tmp_str, json_object_get(
+					json_object_array_get_idx(data, 1)));
 
 	} else if (strcmp(sig_name, "TechnologyAdded") == 0) {
 		json_object_array_add(technologies, json_object_get(data));
+		index_add(technologies_index, data);
 
 	} else if (strcmp(sig_name, "TechnologyRemoved") == 0) {
-		tmp_str = json_object_get_string(data);
 		tmp_array = json_object_new_array();
-		len = json_object_array_length(technologies);
+		json_object_array_add(tmp_array, json_object_get(data));
+		technologies = remove_technologies(technologies,
+				technologies_index, tmp_array);
+		json_object_put(tmp_array);
+	}
 
-		for (i = 0; i < len; i++) {
-			sub_array = json_object_array_get_idx(technologies, i);
-			assert(sub_array != NULL);
-			tmp = json_object_array_get_idx(sub_array, 0);
-			assert(tmp != NULL);
+	// We ignore PeersChanged: we don't support P2P
+}
 
-			if (strcmp(tmp_str, json_object_get_string(tmp)) != 0) {
-				json_object_array_add(tmp_array, sub_array);
-			}
+// req is left to the caller if it fails
+static int engine_query_run(struct json_object *jobj, enum command_id cmd_id,
+		struct engine_request *req)
+{
+	struct json_object *jcmd_data;
+	int res;
+
+	json_object_object_get_ex(jobj, key_command_data, &jcmd_data);
+	res = cmd_table[cmd_id].func(jcmd_data, req);
+	json_object_put(jobj);
+
+	return res;
+}
+
+/*
+ * Threaded mode (engine_thread_start): the dbus thread owns the connection
+ * and the cache. engine_query hands it the queries through thread_queries,
+ * it hands the callbacks back through thread_events. Each ring has an
+ * eventfd to wake its consumer, space_fd wakes the dbus thread when
+ * thread_events was full.
+ */
+#define THREAD_EVENTS_SIZE 256
+#define THREAD_QUERIES_SIZE 64
+
+struct thread_event {
+	int status;
+	struct json_object *jobj;
+	struct engine_request *req;	// NULL: engine_callback
+};
+
+struct thread_query {
+	enum command_id cmd_id;
+	struct json_object *jobj;
+	struct engine_request *req;
+};
+
+static __thread bool in_dbus_thread;
+static pthread_t dbus_thread;
+static struct spsc_ring *thread_events;
+static struct spsc_ring *thread_queries;
+static int events_fd = -1;
+static int queries_fd = -1;
+static int space_fd = -1;
+static int producer_waiting;
+static int thread_stopping;
+static void (*ui_callback)(int status, struct json_object *jobj);
+
+static void fd_signal(int fd)
+{
+	uint64_t one = 1;
+
+	if (write(fd, &one, sizeof(one)) < 0)
+		return;
+}
+
+static void fd_clear(int fd)
+{
+	uint64_t val;
+
+	if (read(fd, &val, sizeof(val)) < 0)
+		return;
+}
+
+static void fd_wait(int fd, int timeout)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+
+	if (poll(&pfd, 1, timeout) > 0)
+		fd_clear(fd);
+}
+
+/*
+ * engine_callback in the dbus thread. The event is a copy: the ui thread
+ * must not touch the reference counts of the cache.
+ */
+static void thread_publish_request(struct engine_request *req, int status,
+		struct json_object *jobj)
+{
+	struct thread_event event;
+
+	event.status = status;
+	event.jobj = __json_object_copy(jobj);
+	event.req = req;
+	json_object_put(jobj);
+
+	while (!__spsc_ring_push(thread_events, &event)) {
+		__atomic_store_n(&producer_waiting, 1, __ATOMIC_SEQ_CST);
+
+		// the ui thread may have emptied the ring in the meantime
+		if (__spsc_ring_push(thread_events, &event))
+			break;
+
+		if (__atomic_load_n(&thread_stopping, __ATOMIC_SEQ_CST)) {
+			json_object_put(event.jobj);
+			free(req);
+			return;
 		}
 
-		//json_object_put(technologies);
-		technologies = tmp_array;
-		json_object_get(technologies);
+		fd_wait(space_fd, 100);
 	}
 
-	// We ignore PeersChanged: we don't support P2P
+	fd_signal(events_fd);
 }
 
-int engine_query(struct json_object *jobj)
+static void thread_publish(int status, struct json_object *jobj)
+{
+	thread_publish_request(NULL, status, jobj);
+}
+
+// in the ui thread
+static void thread_events_ready(int fd, void *data)
+{
+	struct thread_event event;
+	uint64_t start;
+
+	fd_clear(fd);
+
+	while (__spsc_ring_pop(thread_events, &event)) {
+		if (__atomic_exchange_n(&producer_waiting, 0,
+					__ATOMIC_SEQ_CST))
+			fd_signal(space_fd);
+
+		start = __latency_now();
+
+		if (event.req) {
+			event.req->cb(event.req->id, event.status, event.jobj,
+					event.req->user_data);
+			free(event.req);
+		} else
+			ui_callback(event.status, event.jobj);
+
+		__latency_record(LATENCY_CALLBACK, start);
+	}
+}
+
+static void thread_query_failed(enum command_id cmd_id, int res,
+		struct engine_request *req)
+{
+	request_complete(req, res, query_error(cmd_id, res));
+}
+
+// in the dbus thread
+static void thread_queries_ready(int fd, void *data)
+{
+	struct thread_query query;
+	int res;
+
+	fd_clear(fd);
+
+	if (__atomic_load_n(&thread_stopping, __ATOMIC_SEQ_CST)) {
+		loop_quit();
+		return;
+	}
+
+	while (__spsc_ring_pop(thread_queries, &query)) {
+		res = engine_query_run(query.jobj, query.cmd_id, query.req);
+
+		if (res < 0 && res != -EINPROGRESS)
+			thread_query_failed(query.cmd_id, res, query.req);
+	}
+}
+
+static int thread_query_post(struct json_object *jobj, enum command_id cmd_id,
+		struct engine_request *req)
+{
+	struct thread_query query = { cmd_id, jobj, req };
+
+	if (!__spsc_ring_push(thread_queries, &query)) {
+		json_object_put(jobj);
+		free(req);
+		return -EAGAIN;
+	}
+
+	fd_signal(queries_fd);
+
+	return -EINPROGRESS;
+}
+
+static void* thread_main(void *data)
+{
+	in_dbus_thread = true;
+	loop_init();
+	loop_add_fd(queries_fd, thread_queries_ready, NULL);
+	loop_run(false);
+	loop_detach();
+	loop_destroy();
+
+	return NULL;
+}
+
+static void thread_free(void)
+{
+	struct thread_event event;
+	struct thread_query query;
+
+	// what the other side didn't get to
+	while (thread_events && __spsc_ring_pop(thread_events, &event)) {
+		json_object_put(event.jobj);
+		free(event.req);
+	}
+
+	while (thread_queries && __spsc_ring_pop(thread_queries, &query)) {
+		json_object_put(query.jobj);
+		free(query.req);
+	}
+
+	__spsc_ring_free(thread_events);
+	__spsc_ring_free(thread_queries);
+	thread_events = NULL;
+	thread_queries = NULL;
+
+	if (events_fd >= 0)
+		close(events_fd);
+
+	if (queries_fd >= 0)
+		close(queries_fd);
+
+	if (space_fd >= 0)
+		close(space_fd);
+
+	events_fd = queries_fd = space_fd = -1;
+}
+
+/*
+ * Moves the dbus connection and the cache to a thread of their own: the
+ * signals are decoded and applied there, the caller's loop only gets the
+ * engine_callback calls. A signal storm then doesn't delay the keystrokes.
+ * Call it after engine_init, from the thread running the ui loop. From then
+ * on only engine_query may be used there, not the connection.
+ */
+int engine_thread_start(void)
+{
+	sigset_t all, old;
+	int res;
+
+	if (threaded)
+		return -EALREADY;
+
+	thread_events = __spsc_ring_new(THREAD_EVENTS_SIZE,
+			sizeof(struct thread_event));
+	thread_queries = __spsc_ring_new(THREAD_QUERIES_SIZE,
+			sizeof(struct thread_query));
+	events_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	queries_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	space_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if (events_fd < 0 || queries_fd < 0 || space_fd < 0) {
+		res = -errno;
+		thread_free();
+		return res;
+	}
+
+	if ((res = loop_add_fd(events_fd, thread_events_ready, NULL)) < 0) {
+		thread_free();
+		return res;
+	}
+
+	ui_callback = engine_callback;
+	engine_callback = thread_publish;
+	threaded = true;
+	loop_detach();
+
+	// the signals stay for the ui thread, not the faults
+	sigfillset(&all);
+	sigdelset(&all, SIGSEGV);
+	sigdelset(&all, SIGBUS);
+	sigdelset(&all, SIGFPE);
+	sigdelset(&all, SIGILL);
+	sigdelset(&all, SIGABRT);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	res = pthread_create(&dbus_thread, NULL, thread_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (res != 0) {
+		threaded = false;
+		engine_callback = ui_callback;
+		loop_init();
+		loop_remove_fd(events_fd);
+		thread_free();
+		return -res;
+	}
+
+	return 0;
+}
+
+// the connection and the cache come back to the calling thread
+static void thread_stop(void)
+{
+	if (!threaded)
+		return;
+
+	__atomic_store_n(&thread_stopping, 1, __ATOMIC_SEQ_CST);
+	fd_signal(queries_fd);
+	pthread_join(dbus_thread, NULL);
+
+	threaded = false;
+	thread_stopping = 0;
+	producer_waiting = 0;
+	engine_callback = ui_callback;
+	loop_remove_fd(events_fd);
+	loop_init();
+	thread_free();
+}
+
+/*
+ * The query may carry an id, a positive integer given back to cb:
+ {
+	"command": "get_state",
+	"id": 42
+ }
+ * cb is called once with the reply, in the caller's thread, unless the
+ * query fails right away. Without cb the reply goes to engine_callback.
+ * jobj is released whatever the result.
+ */
+int engine_query_full(struct json_object *jobj, engine_reply_func_t cb,
+		void *user_data)
 {
 	const char *command_str = NULL;
-	int res, cmd_pos;
-	struct json_object *jcmd_data;
+	enum command_id cmd_id;
+	struct json_object *jcmd_data, *jid;
+	struct engine_request *req;
+	int64_t id = 0;
+	int res;
 
 	command_str = __json_get_command_str(jobj);
+	cmd_id = __command_id(command_str);
 
-	if (!command_str || (cmd_pos = command_exist(command_str)) < 0)
+	if (cmd_id == CMD_UNKNOWN || !cmd_table[cmd_id].func) {
+		json_object_put(jobj);
 		return -EINVAL;
+	}
 	
 	json_object_object_get_ex(jobj, key_command_data, &jcmd_data);
 
-	if (jcmd_data != NULL && !command_data_is_clean(jcmd_data, cmd_pos))
+	if (cmd_id == CMD_BATCH ? !batch_is_clean(jcmd_data) :
+			jcmd_data != NULL &&
+			!command_data_is_clean(jcmd_data, cmd_id)) {
+		json_object_put(jobj);
 		return -EINVAL;
-	
-	res = cmd_table[cmd_pos].func(jcmd_data);
-	json_object_put(jobj);
+	}
+
+	if (json_object_object_get_ex(jobj, key_command_id, &jid)) {
+		if (json_object_get_type(jid) == json_type_int)
+			id = json_object_get_int64(jid);
+
+		if (id <= 0 || id > UINT32_MAX) {
+			json_object_put(jobj);
+			return -EINVAL;
+		}
+	}
+
+	req = malloc(sizeof(struct engine_request));
+
+	if (!req) {
+		json_object_put(jobj);
+		return -ENOMEM;
+	}
+
+	req->id = id;
+	req->cb = cb;
+	req->user_data = user_data;
+	req->batch = NULL;
+
+	if (threaded && !in_dbus_thread)
+		return thread_query_post(jobj, cmd_id, req);
+
+	res = engine_query_run(jobj, cmd_id, req);
+
+	if (res < 0 && res != -EINPROGRESS)
+		free(req);
 
 	return res;
 }
 
+int engine_query(struct json_object *jobj)
+{
+	return engine_query_full(jobj, NULL, NULL);
+}
+
+static void snapshot_save(void)
+{
+	if (__snapshot_save(__snapshot_default_path(), state, technologies,
+				services) == 0)
+		snapshot_dirty = false;
+}
+
+/*
+ * Tell the client the cache changed under its feet, like a signal does.
+ */
+static void notify_reconciled(void)
+{
+	struct json_object *jobj = json_object_new_object();
+
+	json_object_object_add(jobj, key_dbus_json_signal_key,
+			json_object_new_string("SnapshotReconciled"));
+	ui_notify(ENGINE_SIGNAL_STATUS, jobj);
+}
+
+static void init_request_done(int error)
+{
+	if (error && !init_error)
+		init_error = error;
+
+	if (--init_pending)
+		return;
+
+	if (!init_from_snapshot) {
+		loop_quit();
+
+		if (!init_error)
+			snapshot_save();
+
+		return;
+	}
+
+	// we are in the main loop of the client now
+	if (init_changes) {
+		snapshot_save();
+		notify_reconciled();
+	}
+}
+
+/*
+ * A failed request during a reconciliation doesn't fail anything: the
+ * cached view stays, the client is told about the error.
+ */
+static bool init_reply_error(struct json_object *data, json_bool is_error)
+{
+	if (!is_error)
+		return false;
+
+	if (init_from_snapshot)
+		ui_notify(1, data);
+	else
+		json_object_put(data);
+
+	init_request_done(-EIO);
+
+	return true;
+}
+
+/*
+ * Update dict with the values of new_dict in place, the keys whose value
+ * didn't change are kept. Returns 0 if nothing changed.
+ */
+static int reconcile_dict(struct json_object *dict,
+		struct json_object *new_dict)
+{
+	struct json_object *new_val, *stale = json_object_new_array();
+	int added = 0, i, len;
+
+	// values modified or removed
+	json_object_object_foreach(dict, key, val) {
+		if (!json_object_object_get_ex(new_dict, key, &new_val) ||
+				strcmp(json_object_to_json_string(val),
+					json_object_to_json_string(new_val)))
+			json_object_array_add(stale, json_object_new_string(key));
+	}
+
+	len = json_object_array_length(stale);
+
+	for (i = 0; i < len; i++)
+		json_object_object_del(dict, json_object_get_string(
+					json_object_array_get_idx(stale, i)));
+
+	json_object_put(stale);
+
+	json_object_object_foreach(new_dict, key2, val2) {
+		if (!json_object_object_get_ex(dict, key2, NULL)) {
+			json_object_object_add(dict, key2, json_object_get(val2));
+			added++;
+		}
+	}
+
+	return len + added;
+}
+
+/*
+ * The technologies are few: they are replaced if any of them changed.
+ */
+static int reconcile_technologies(struct json_object *new_techs)
+{
+	struct json_object *sub_array, *old;
+	const char *name;
+	int i, len = json_object_array_length(new_techs);
+
+	if (len == json_object_array_length(technologies)) {
+		for (i = 0; i < len; i++) {
+			sub_array = json_object_array_get_idx(new_techs, i);
+			name = json_object_get_string(
+					json_object_array_get_idx(sub_array, 0));
+			old = search_technology_or_service(technologies_index,
+					name);
+
+			if (!old || strcmp(json_object_to_json_string(old),
+						json_object_to_json_string(
+							sub_array)) != 0)
+				break;
+		}
+
+		if (i == len) {
+			json_object_put(new_techs);
+			return 0;
+		}
+	}
+
+	json_object_put(technologies);
+	technologies = new_techs;
+	technologies_index = index_build(technologies_index, technologies);
+
+	return 1;
+}
+
+static void init_state_cb(struct json_object *data, json_bool is_error,
+		void *user_data)
+{
+	if (init_reply_error(data, is_error))
+		return;
+
+	if (init_from_snapshot) {
+		init_changes += reconcile_dict(state, data);
+		json_object_put(data);
+	} else
+		state = data;
+
+	init_request_done(0);
+}
+
+static void init_technologies_cb(struct json_object *data,
+		json_bool is_error, void *user_data)
+{
+	if (init_reply_error(data, is_error))
+		return;
+
+	if (init_from_snapshot)
+		init_changes += reconcile_technologies(data);
+	else {
+		technologies = data;
+		technologies_index = index_build(technologies_index,
+				technologies);
+	}
+
+	init_request_done(0);
+}
+
+static void init_services_cb(struct json_object *data, json_bool is_error,
+		void *user_data)
+{
+	if (init_reply_error(data, is_error))
+		return;
+
+	if (init_from_snapshot)
+		init_changes += __service_table_reconcile(services, data);
+	else
+		__service_table_load(services, data);
+
+	json_object_put(data);
+	init_request_done(0);
+}
+
+/*
+ * Without a snapshot to reconcile with, the services are loaded from the
+ * message itself: no json tree of the whole reply.
+ */
+static bool init_services_peek(DBusMessageIter *iter, void *user_data)
+{
+	if (init_from_snapshot || __service_table_load_dbus(services,
+				iter, engine_decode_workers) < 0)
+		return false;
+
+	init_request_done(0);
+
+	return true;
+}
+
+// another agent may be registered already, we can live without ours
+static void init_agent_cb(bool registered)
+{
+	agent_registered_callback = NULL;
+	init_request_done(0);
+}
+
 int engine_init(void)
 {
 	DBusError dbus_err;
@@ -585,8 +1621,11 @@ int engine_init(void)
 		return -1;
 	}
 
+	validators_compile();
+
 	commands_callback = engine_commands_cb;
 	commands_signal = engine_commands_sig;
+	commands_property_changed = engine_property_changed;
 	agent_callback = engine_agent_cb;
 	agent_error_callback = engine_agent_error_cb;
 
@@ -605,33 +1644,72 @@ int engine_init(void)
 	
 	// We need the loop to get callbacks to init our things
 	loop_init();
-	init_status = INIT_STATE;
-	res = get_state(NULL);
+	services = __service_table_new();
+
+	// the last known view, the replies will be reconciled with it
+	if (__snapshot_load(__snapshot_default_path(), &state, &technologies,
+				services) == 0) {
+		technologies_index = index_build(technologies_index,
+				technologies);
+		init_from_snapshot = true;
+	}
 
-	if (res != -EINPROGRESS)
-		return res;
-	
-	loop_run(false);
-	init_status = INIT_TECHNOLOGIES;
+	/*
+	 * All the initial requests are sent at once, each reply is routed to
+	 * its own callback: one round-trip instead of one per request.
+	 */
+	init_pending = 1;
+	init_error = 0;
 
-	if ((res = get_technologies(NULL)) != -EINPROGRESS)
-		return res;
-	
-	loop_run(false);
-	init_status = INIT_SERVICES;
+	if ((res = __cmd_state(init_state_cb, NULL)) == -EINPROGRESS)
+		init_pending++;
 
-	if ((res = get_services(NULL)) != -EINPROGRESS)
-		return res;
+	if (res == -EINPROGRESS && (res = __cmd_technologies(
+				init_technologies_cb, NULL)) == -EINPROGRESS)
+		init_pending++;
 
-	loop_run(false);
-	init_status = INIT_OVER;
+	if (res == -EINPROGRESS && (res = __cmd_services_peek(
+				init_services_cb, init_services_peek,
+				NULL)) == -EINPROGRESS)
+		init_pending++;
 
-	return 0;
+	if (res == -EINPROGRESS) {
+		agent_registered_callback = init_agent_cb;
+
+		if (__connman_agent_register(connection) == -EINPROGRESS)
+			init_pending++;
+		else
+			agent_registered_callback = NULL;
+	}
+
+	if (init_from_snapshot) {
+		// the client can draw the cached view right now
+		init_pending--;
+		return (res == -EINPROGRESS ? 0 : res);
+	}
+
+	// the requests already sent must be answered before we return
+	if (--init_pending)
+		loop_run(false);
+
+	if (res != -EINPROGRESS)
+		return res;
+
+	return init_error;
 }
 
 void engine_terminate(void)
 {
+	thread_stop();
+
+	if (snapshot_dirty)
+		snapshot_save();
+
+	json_object_put(state);
+	json_object_put(technologies_index);
 	json_object_put(technologies);
-	json_object_put(services);
+	__service_table_free(services);
+	validators_free();
+	__atoms_terminate();
 }
 
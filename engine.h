@@ -30,10 +30,33 @@ extern DBusConnection *connection;
 
 extern void (*engine_callback)(int status, struct json_object *jobj);
 
+/* The status engine_callback gets for the signals. */
+#define ENGINE_SIGNAL_STATUS 12345
+
+/*
+ * Threads decoding a big GetServices reply in engine_init, 0 or 1 to do it
+ * in the calling thread (the default). Set it before engine_init.
+ */
+extern unsigned int engine_decode_workers;
+
+/*
+ * The reply to one query of engine_query_full. id is the "id" of the query,
+ * 0 if it has none. jobj is NULL for a dbus method without result.
+ */
+typedef void (*engine_reply_func_t)(unsigned int id, int status,
+		struct json_object *jobj, void *user_data);
+
 int engine_query(struct json_object *jobj);
 
+int engine_query_full(struct json_object *jobj, engine_reply_func_t cb,
+		void *user_data);
+
 int engine_init(void);
 
+int engine_thread_start(void);
+
+void engine_subscribe_signals(bool subscribed);
+
 void engine_terminate(void);
 
 #ifdef __cplusplus
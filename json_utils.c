@@ -28,22 +28,200 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
 
+#include "atoms.h"
 #include "json_utils.h"
 
+/*
+ * The compiled regexes of __match_strings, the least recently used one is
+ * replaced when the cache is full. The lock only covers the lookup: users
+ * counts the threads running regexec on an entry, which is not replaced
+ * until they are done, and a stale entry (cleared while in use) is freed
+ * by its last user.
+ */
+static struct regex_cache_entry {
+	char *pattern;
+	uint32_t hash;
+	unsigned long last_use;
+	unsigned int users;
+	bool stale;
+	regex_t regex;
+} regex_cache[REGEX_CACHE_SIZE];
+
+static struct regex_cache_stats regex_cache_stats;
+static unsigned long regex_cache_clock;
+static pthread_mutex_t regex_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t hash_pattern(const char *str)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*str) {
+		hash ^= (unsigned char) *str++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static void regex_cache_free(struct regex_cache_entry *entry)
+{
+	regfree(&entry->regex);
+	free(entry->pattern);
+	entry->pattern = NULL;
+	entry->stale = false;
+}
+
+/*
+ * The entry of pattern with one more user, NULL if it isn't cached. Called
+ * with the lock held.
+ */
+static struct regex_cache_entry* regex_cache_get(const char *pattern,
+		uint32_t hash)
+{
+	struct regex_cache_entry *entry;
+	int i;
+
+	for (i = 0; i < REGEX_CACHE_SIZE; i++) {
+		entry = &regex_cache[i];
+
+		if (entry->pattern && !entry->stale && entry->hash == hash &&
+				strcmp(entry->pattern, pattern) == 0) {
+			entry->users++;
+			entry->last_use = ++regex_cache_clock;
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static void regex_cache_put(struct regex_cache_entry *entry)
+{
+	entry->users--;
+
+	if (entry->stale && entry->users == 0)
+		regex_cache_free(entry);
+}
+
+/*
+ * Keep the regex compiled by __match_strings in a free entry or in place of
+ * the least recently used one, it is freed if another thread cached the
+ * same pattern meanwhile or if every entry is in use. Called with the lock
+ * held.
+ */
+static void regex_cache_insert(const char *pattern, uint32_t hash,
+		regex_t *regex)
+{
+	struct regex_cache_entry *entry, *victim = NULL;
+	int i;
+
+	for (i = 0; i < REGEX_CACHE_SIZE; i++) {
+		entry = &regex_cache[i];
+
+		if (entry->pattern && !entry->stale && entry->hash == hash &&
+				strcmp(entry->pattern, pattern) == 0)
+			goto drop;
+
+		if (entry->users)
+			continue;
+
+		if (!victim || (victim->pattern && (!entry->pattern ||
+					entry->last_use < victim->last_use)))
+			victim = entry;
+	}
+
+	if (!victim)
+		goto drop;
+
+	if (victim->pattern) {
+		regex_cache_stats.evictions++;
+		regex_cache_free(victim);
+	}
+
+	victim->pattern = strdup(pattern);
+
+	if (!victim->pattern)
+		goto drop;
+
+	victim->regex = *regex;
+	victim->hash = hash;
+	victim->last_use = ++regex_cache_clock;
+	return;
+
+drop:
+	regfree(regex);
+}
+
 bool __match_strings(const char *str, const char *trusted)
 {
-	int regexp_err, regexp_match;
-	regex_t preg;
+	struct regex_cache_entry *entry;
+	uint32_t hash = hash_pattern(trusted);
+	regex_t regex;
+	int regexp_match;
+
+	pthread_mutex_lock(&regex_cache_lock);
+	entry = regex_cache_get(trusted, hash);
+
+	if (entry)
+		regex_cache_stats.hits++;
+	else
+		regex_cache_stats.misses++;
+
+	pthread_mutex_unlock(&regex_cache_lock);
+
+	if (entry) {
+		regexp_match = regexec(&entry->regex, str, 0, NULL, 0);
 
-	regexp_err = regcomp(&preg, trusted, REG_NOSUB | REG_EXTENDED);
-	assert(regexp_err == 0);
-	regexp_match = regexec(&preg, str, 0, NULL, 0);
-	regfree(&preg);
+		pthread_mutex_lock(&regex_cache_lock);
+		regex_cache_put(entry);
+		pthread_mutex_unlock(&regex_cache_lock);
+
+		return (regexp_match == 0);
+	}
+
+	// a pattern that doesn't compile matches nothing and isn't cached
+	if (regcomp(&regex, trusted, REG_NOSUB | REG_EXTENDED) != 0)
+		return false;
+
+	regexp_match = regexec(&regex, str, 0, NULL, 0);
+
+	pthread_mutex_lock(&regex_cache_lock);
+	regex_cache_insert(trusted, hash, &regex);
+	pthread_mutex_unlock(&regex_cache_lock);
 
 	return (regexp_match == 0);
 }
 
+void __match_strings_stats(struct regex_cache_stats *stats)
+{
+	pthread_mutex_lock(&regex_cache_lock);
+	*stats = regex_cache_stats;
+	pthread_mutex_unlock(&regex_cache_lock);
+}
+
+void __match_strings_cache_clear(void)
+{
+	int i;
+
+	pthread_mutex_lock(&regex_cache_lock);
+
+	for (i = 0; i < REGEX_CACHE_SIZE; i++) {
+		if (!regex_cache[i].pattern)
+			continue;
+
+		if (regex_cache[i].users)
+			regex_cache[i].stale = true;
+		else
+			regex_cache_free(&regex_cache[i]);
+	}
+
+	pthread_mutex_unlock(&regex_cache_lock);
+}
+
 static bool json_match_string(struct json_object *jobj,
 		struct json_object *jtrusted)
 {
@@ -103,11 +281,17 @@ bool __json_type_dispatch(struct json_object *jobj,
 		struct json_object *jtrusted)
 {
 	enum json_type type, type_trusted;
+	const struct named_validator *named;
 	bool res;
 
 	type = json_object_get_type(jobj);
 	type_trusted = json_object_get_type(jtrusted);
 
+	// "@ipv4": the validator decides which types it accepts
+	if (type_trusted == json_type_string && (named = __validator_lookup(
+					json_object_get_string(jtrusted))))
+		return __validator_match_json(named, jobj);
+
 	if (type != type_trusted)
 		return false;
 
@@ -133,6 +317,194 @@ bool __json_type_dispatch(struct json_object *jobj,
 	return res;
 }
 
+static int validator_compile_object(struct json_validator *validator,
+		struct json_object *jtrusted)
+{
+	unsigned int i = 0;
+
+	json_object_object_foreach(jtrusted, key, val)
+		validator->u.object.nb_keys += (key && val) ? 1 : 0;
+
+	validator->u.object.keys = calloc(validator->u.object.nb_keys + 1,
+			sizeof(char *));
+	validator->u.object.values = calloc(validator->u.object.nb_keys + 1,
+			sizeof(struct json_validator *));
+	assert(validator->u.object.keys && validator->u.object.values);
+
+	json_object_object_foreach(jtrusted, key2, val2) {
+		if (!key2 || !val2)
+			continue;
+
+		validator->u.object.keys[i] = strdup(key2);
+		validator->u.object.values[i] = __json_validator_compile(val2);
+
+		if (!validator->u.object.values[i++])
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * The validator of jtrusted, NULL if jtrusted isn't a valid trusted json
+ * (bad regex, empty array...).
+ */
+struct json_validator* __json_validator_compile(struct json_object *jtrusted)
+{
+	struct json_validator *res;
+	struct json_object *elem;
+
+	if (!jtrusted)
+		return NULL;
+
+	res = calloc(1, sizeof(struct json_validator));
+	assert(res != NULL);
+	res->type = json_object_get_type(jtrusted);
+
+	switch (res->type) {
+
+		case json_type_string:
+			res->named = __validator_lookup(
+					json_object_get_string(jtrusted));
+
+			if (res->named)
+				break;
+
+			if (regcomp(&res->u.regex, json_object_get_string(
+						jtrusted), REG_NOSUB |
+						REG_EXTENDED) != 0) {
+				free(res);
+				return NULL;
+			}
+			break;
+
+		case json_type_object:
+			if (validator_compile_object(res, jtrusted) < 0) {
+				__json_validator_free(res);
+				return NULL;
+			}
+			break;
+
+		case json_type_array:
+			elem = json_object_array_get_idx(jtrusted, 0);
+
+			if (!elem || !(res->u.elem =
+						__json_validator_compile(elem))) {
+				free(res);
+				return NULL;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	return res;
+}
+
+void __json_validator_free(struct json_validator *validator)
+{
+	unsigned int i;
+
+	if (!validator)
+		return;
+
+	switch (validator->type) {
+
+		case json_type_string:
+			if (!validator->named)
+				regfree(&validator->u.regex);
+			break;
+
+		case json_type_object:
+			for (i = 0; i < validator->u.object.nb_keys; i++) {
+				free(validator->u.object.keys[i]);
+				__json_validator_free(
+						validator->u.object.values[i]);
+			}
+
+			free(validator->u.object.keys);
+			free(validator->u.object.values);
+			break;
+
+		case json_type_array:
+			__json_validator_free(validator->u.elem);
+			break;
+
+		default:
+			break;
+	}
+
+	free(validator);
+}
+
+static bool validator_match_object(const struct json_validator *validator,
+		struct json_object *jobj)
+{
+	const struct json_validator *tmp;
+	unsigned int i;
+
+	json_object_object_foreach(jobj, key, val) {
+		tmp = NULL;
+
+		for (i = 0; i < validator->u.object.nb_keys; i++) {
+			if (strcmp(validator->u.object.keys[i], key) == 0) {
+				tmp = validator->u.object.values[i];
+				break;
+			}
+		}
+
+		if (!tmp || !__json_validator_match(tmp, val))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Same result as __json_type_dispatch with the trusted json the validator
+ * was compiled from.
+ */
+bool __json_validator_match(const struct json_validator *validator,
+		struct json_object *jobj)
+{
+	int array_len, i;
+
+	if (validator && validator->named)
+		return __validator_match_json(validator->named, jobj);
+
+	if (!validator || json_object_get_type(jobj) != validator->type)
+		return false;
+
+	switch (validator->type) {
+
+		case json_type_string:
+			return regexec(&validator->u.regex,
+					json_object_get_string(jobj), 0, NULL,
+					0) == 0;
+
+		case json_type_object:
+			return validator_match_object(validator, jobj);
+
+		case json_type_array:
+			array_len = json_object_array_length(jobj);
+
+			if (array_len <= 0)
+				return false;
+
+			for (i = 0; i < array_len; i++)
+				if (!__json_validator_match(validator->u.elem,
+						json_object_array_get_idx(jobj,
+							i)))
+					return false;
+
+			return true;
+
+		default:
+			return false;
+	}
+}
+
 static const char* get_string_from_jobj(struct json_object *jobj)
 {
 	if (json_object_get_type(jobj) == json_type_string)
@@ -164,19 +536,71 @@ const char* __json_get_command_str(struct json_object *jobj)
 	return NULL;
 }
 
+static void copy_object(struct json_object *dst, struct json_object *src)
+{
+	json_object_object_foreach(src, key, val)
+		json_object_object_add(dst, key, __json_object_copy(val));
+}
+
+/*
+ * A deep copy sharing nothing with jobj, not even the atoms: it can be
+ * handed to another thread (json-c reference counts aren't atomic).
+ */
+struct json_object* __json_object_copy(struct json_object *jobj)
+{
+	struct json_object *res;
+	int i, len;
+
+	switch (json_object_get_type(jobj)) {
+
+		case json_type_boolean:
+			return json_object_new_boolean(
+					json_object_get_boolean(jobj));
+
+		case json_type_double:
+			return json_object_new_double(
+					json_object_get_double(jobj));
+
+		case json_type_int:
+			return json_object_new_int64(
+					json_object_get_int64(jobj));
+
+		case json_type_string:
+			return json_object_new_string_len(
+					json_object_get_string(jobj),
+					json_object_get_string_len(jobj));
+
+		case json_type_object:
+			res = json_object_new_object();
+			copy_object(res, jobj);
+			return res;
+
+		case json_type_array:
+			len = json_object_array_length(jobj);
+			res = json_object_new_array();
+
+			for (i = 0; i < len; i++)
+				json_object_array_add(res, __json_object_copy(
+						json_object_array_get_idx(jobj,
+							i)));
+			return res;
+
+		default:
+			return NULL;
+	}
+}
+
 /*
  * This get the last token ('/') of str.
- * Don't forget to free the return value.
+ * The return value is an interned atom, don't free it: only for the names
+ * there are few of, like the technologies.
  */
-char* __extract_dbus_short_name(const char *str)
+const char* __extract_dbus_short_name(const char *str)
 {
-	char *last_token = strrchr(str, '/'), *res;
+	const char *last_token = strrchr(str, '/');
 
 	if (!last_token)
 		return NULL;
 
-	last_token++;
-	res = strdup(last_token);
-
-	return res;
+	return __atom_intern(last_token + 1);
 }
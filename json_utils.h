@@ -20,18 +20,66 @@
 #ifndef __CONNMAN_JSON_UTILS_H
 #define __CONNMAN_JSON_UTILS_H
 
+#include <stdbool.h>
+#include <regex.h>
+#include <json/json.h>
+
+#include "validators.h"
+
+/* patterns whose compiled regex __match_strings keeps */
+#define REGEX_CACHE_SIZE 32
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct regex_cache_stats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+};
+
 bool __match_strings(const char *str, const char *trusted);
 
+void __match_strings_stats(struct regex_cache_stats *stats);
+
+void __match_strings_cache_clear(void);
+
 bool __json_type_dispatch(struct json_object *jobj,
 		struct json_object *jtrusted);
 
+/*
+ * A trusted json (see __json_type_dispatch) compiled once: the regexes are
+ * compiled and the keys of the objects are ready to be looked up.
+ */
+struct json_validator {
+	enum json_type type;
+	const struct named_validator *named;	// used instead of u.regex
+	union {
+		regex_t regex;
+
+		struct {
+			unsigned int nb_keys;
+			char **keys;
+			struct json_validator **values;
+		} object;
+
+		struct json_validator *elem;
+	} u;
+};
+
+struct json_validator* __json_validator_compile(struct json_object *jtrusted);
+
+void __json_validator_free(struct json_validator *validator);
+
+bool __json_validator_match(const struct json_validator *validator,
+		struct json_object *jobj);
+
 const char* __json_get_command_str(struct json_object *jobj);
 
-char* __extract_dbus_short_name(const char *str);
+struct json_object* __json_object_copy(struct json_object *jobj);
+
+const char* __extract_dbus_short_name(const char *str);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,239 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <json/json.h>
+
+#include "latency.h"
+
+/*
+ * HDR-like histograms: values below 2^LATENCY_SUB_BITS get one bucket each,
+ * then every power of 2 is split in 2^LATENCY_SUB_BITS buckets. The relative
+ * error stays under 1/2^LATENCY_SUB_BITS (6%) from 1 ns to hours, in a
+ * fixed array. The loop of each thread records in the same histograms, the
+ * counters are atomic.
+ */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+struct histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[LATENCY_BUCKETS];
+};
+
+static const char *latency_names[NB_LATENCIES] = {
+	[LATENCY_WAKE_TO_WATCH] = "wake_to_watch",
+	[LATENCY_DISPATCH] = "dispatch",
+	[LATENCY_SIGNAL] = "signal",
+	[LATENCY_CALLBACK] = "callback",
+	[LATENCY_INPUT] = "input",
+};
+
+static struct histogram histograms[NB_LATENCIES];
+static int dump_requested;	// the loops of both threads look at it
+
+const char *latency_dump_path = NULL;
+
+static unsigned int bucket_of(uint64_t val)
+{
+	unsigned int msb;
+
+	if (val < LATENCY_SUB_BUCKETS)
+		return val;
+
+	msb = 63 - __builtin_clzll(val);
+
+	return (msb - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS +
+		((val >> (msb - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+// the middle of the values counted by the bucket
+static uint64_t bucket_value(unsigned int bucket)
+{
+	unsigned int shift;
+	uint64_t lowest;
+
+	if (bucket < LATENCY_SUB_BUCKETS)
+		return bucket;
+
+	shift = bucket / LATENCY_SUB_BUCKETS - 1;
+	lowest = (uint64_t) (LATENCY_SUB_BUCKETS + bucket %
+			LATENCY_SUB_BUCKETS) << shift;
+
+	return lowest + ((1ULL << shift) >> 1);
+}
+
+uint64_t __latency_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void __latency_record(enum latency_id id, uint64_t start)
+{
+	struct histogram *hist = &histograms[id];
+	uint64_t val = __latency_now() - start;
+	uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+	__atomic_fetch_add(&hist->buckets[bucket_of(val)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->sum, val, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+
+	while (val > max && !__atomic_compare_exchange_n(&hist->max, &max, val,
+				true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/*
+ * The value under which are ratio of the recorded values, from a copy of
+ * the buckets (the other thread can still record).
+ */
+static uint64_t percentile(const uint64_t *buckets, uint64_t count,
+		double ratio)
+{
+	uint64_t rank = count * ratio, seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += buckets[i];
+
+		if (seen > rank)
+			return bucket_value(i);
+	}
+
+	return 0;
+}
+
+/*
+ * In ns:
+ {
+	"count": 1234,
+	"mean": 5678,
+	"p50": 4100,
+	"p90": 9200,
+	"p99": 31000,
+	"p999": 120000,
+	"max": 250123
+ }
+ */
+static struct json_object* histogram_json(struct histogram *hist)
+{
+	static const struct {
+		const char *name;
+		double ratio;
+	} percentiles[] = {
+		{ "p50", 0.5 },
+		{ "p90", 0.9 },
+		{ "p99", 0.99 },
+		{ "p999", 0.999 },
+	};
+	uint64_t buckets[LATENCY_BUCKETS], count = 0, val;
+	uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+	struct json_object *res = json_object_new_object();
+	unsigned int i;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		buckets[i] = __atomic_load_n(&hist->buckets[i],
+				__ATOMIC_RELAXED);
+		count += buckets[i];
+	}
+
+	json_object_object_add(res, "count", json_object_new_int64(count));
+	json_object_object_add(res, "mean", json_object_new_int64(count ?
+				__atomic_load_n(&hist->sum, __ATOMIC_RELAXED) /
+				count : 0));
+
+	// the middle of the last bucket can be above the max
+	for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+		val = percentile(buckets, count, percentiles[i].ratio);
+		json_object_object_add(res, percentiles[i].name,
+				json_object_new_int64(val < max ? val : max));
+	}
+
+	json_object_object_add(res, "max", json_object_new_int64(max));
+
+	return res;
+}
+
+/*
+ {
+	"wake_to_watch": { histogram },
+	"dispatch": { histogram },
+	"signal": { histogram },
+	"callback": { histogram },
+	"input": { histogram }
+ }
+ */
+struct json_object* __latency_json(void)
+{
+	struct json_object *res = json_object_new_object();
+	int i;
+
+	for (i = 0; i < NB_LATENCIES; i++)
+		json_object_object_add(res, latency_names[i],
+				histogram_json(&histograms[i]));
+
+	return res;
+}
+
+void __latency_request_dump(int signum)
+{
+	__atomic_store_n(&dump_requested, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * The dump isn't done by the signal handler: the loop calls this after
+ * epoll_wait, which the signal interrupts.
+ */
+void __latency_dump_requested(void)
+{
+	struct json_object *jobj;
+	int fd;
+
+	if (!__atomic_exchange_n(&dump_requested, 0, __ATOMIC_RELAXED))
+		return;
+
+	jobj = __latency_json();
+
+	if (!latency_dump_path) {
+		fprintf(stderr, "%s\n", json_object_to_json_string(jobj));
+		fflush(stderr);
+	} else if ((fd = open(latency_dump_path, O_WRONLY | O_APPEND |
+					O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+					0600)) >= 0) {
+		dprintf(fd, "%s\n", json_object_to_json_string(jobj));
+		close(fd);
+	}
+
+	json_object_put(jobj);
+}
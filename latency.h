@@ -0,0 +1,66 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_LATENCY_H
+#define __CONNMAN_LATENCY_H
+
+#include <stdint.h>
+#include <json/json.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Histograms of the time spent in the steps between a wakeup of the loop
+ * and the rendering of what it brought.
+ */
+enum latency_id {
+	LATENCY_WAKE_TO_WATCH,	// epoll_wait returns -> first dbus_watch_handle
+	LATENCY_DISPATCH,	// dbus_connection_dispatch, per iteration
+	LATENCY_SIGNAL,		// one commands_signal call
+	LATENCY_CALLBACK,	// one engine_callback call
+	LATENCY_INPUT,		// one ncurses_action call
+	NB_LATENCIES,
+};
+
+/* ns, CLOCK_MONOTONIC */
+uint64_t __latency_now(void);
+
+/* records the time elapsed since start (from __latency_now) */
+void __latency_record(enum latency_id id, uint64_t start);
+
+struct json_object* __latency_json(void);
+
+/*
+ * The file the dumps are appended to, NULL for stderr (the default): the
+ * ncurses ui owns the terminal.
+ */
+extern const char *latency_dump_path;
+
+/* a SIGUSR1 handler: __latency_dump_requested dumps on the next call */
+void __latency_request_dump(int signum);
+
+void __latency_dump_requested(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,60 +23,659 @@
 #include <config.h>
 #endif
 
-#include <poll.h>
+#include <sys/epoll.h>
 #include <dbus/dbus.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "loop.h"
+#include "latency.h"
 
 extern DBusConnection *connection;
-extern void ncurses_action(void);
 
-#define WATCHEDS_MAX_COUNT 20
+void (*loop_stdin_callback)(void) = NULL;
 
-static int stop_loop = 0;
-static DBusWatch *watcheds[WATCHEDS_MAX_COUNT];
-static int watcheds_count;
+/*
+ * Each thread running a loop has its own: the ui thread and, in threaded
+ * mode (see engine_thread_start), the dbus thread. The dbus connection is
+ * attached to one of them.
+ */
 
-static dbus_bool_t add_watch(DBusWatch *watch, void *data)
+/* events handled per wakeup, the others wait for the next epoll_wait */
+#define LOOP_MAX_EVENTS 32
+
+/*
+ * dbus messages dispatched per wakeup, and the time they can take (us):
+ * the other fds (stdin...) get their turn before the rest is dispatched.
+ */
+#define LOOP_DISPATCH_BUDGET 64
+#define LOOP_DISPATCH_TIME_BUDGET 4000
+
+/*
+ * One fd registered in epoll. dbus can give a read and a write watch on
+ * the same fd, they share the source. The other fds (stdin...) have a
+ * func instead of watches, and a write_func while they wait to be writable.
+ */
+struct loop_source {
+	int fd;
+	uint32_t events;	// registered in epoll, 0 if it isn't
+	DBusWatch *read_watch;
+	DBusWatch *write_watch;
+	loop_fd_func_t func;
+	void *data;
+	loop_fd_func_t write_func;
+	void *write_data;
+	bool removed;
+	struct loop_source *next;
+};
+
+static __thread int stop_loop = 0;
+static __thread int epoll_fd = -1;
+static __thread bool attached;	// to the dbus connection
+static __thread bool dispatch_pending;	// the budget was hit
+static __thread struct loop_stats stats;
+static __thread struct loop_source *sources;
+
+/*
+ * The sources removed while loop_run handles events are freed after the
+ * events, another event of the same wakeup can still point to them.
+ */
+static __thread int dispatching;
+static __thread struct loop_source *removed_sources;
+
+static struct loop_source* source_from_fd(int fd)
+{
+	struct loop_source *src;
+
+	for (src = sources; src; src = src->next)
+		if (src->fd == fd)
+			return src;
+
+	return NULL;
+}
+
+static struct loop_source* source_from_watch(DBusWatch *watch)
 {
-	if (watcheds_count >= WATCHEDS_MAX_COUNT)
+	struct loop_source *src;
+
+	for (src = sources; src; src = src->next)
+		if (src->read_watch == watch || src->write_watch == watch)
+			return src;
+
+	return NULL;
+}
+
+static struct loop_source* source_new(int fd)
+{
+	struct loop_source *src = calloc(1, sizeof(struct loop_source));
+
+	if (!src)
+		return NULL;
+
+	src->fd = fd;
+	src->next = sources;
+	sources = src;
+
+	return src;
+}
+
+/*
+ * Registers in epoll what the source waits for now: only the enabled
+ * watches count.
+ */
+static int source_update(struct loop_source *src)
+{
+	struct epoll_event ev;
+	uint32_t events = 0;
+	int op;
+
+	if (src->read_watch && dbus_watch_get_enabled(src->read_watch))
+		events |= EPOLLIN;
+
+	if (src->write_watch && dbus_watch_get_enabled(src->write_watch))
+		events |= EPOLLOUT;
+
+	if (src->func)
+		events |= EPOLLIN;
+
+	if (src->write_func)
+		events |= EPOLLOUT;
+
+	if (events == src->events)
 		return 0;
-	
-	watcheds[watcheds_count++] = watch;
-	return 1;
+
+	if (src->events == 0)
+		op = EPOLL_CTL_ADD;
+	else if (events == 0)
+		op = EPOLL_CTL_DEL;
+	else
+		op = EPOLL_CTL_MOD;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = src;
+
+	if (epoll_ctl(epoll_fd, op, src->fd, &ev) < 0 && op != EPOLL_CTL_DEL)
+		return -errno;
+
+	src->events = events;
+
+	return 0;
+}
+
+// frees the source once nothing uses it
+static void source_release(struct loop_source *src)
+{
+	struct loop_source **pos;
+
+	if (src->read_watch || src->write_watch || src->func ||
+			src->write_func)
+		return;
+
+	source_update(src);
+
+	for (pos = &sources; *pos; pos = &(*pos)->next) {
+		if (*pos == src) {
+			*pos = src->next;
+			break;
+		}
+	}
+
+	if (dispatching) {
+		src->removed = true;
+		src->next = removed_sources;
+		removed_sources = src;
+	} else
+		free(src);
+}
+
+static void free_removed_sources(void)
+{
+	struct loop_source *src;
+
+	while ((src = removed_sources)) {
+		removed_sources = src->next;
+		free(src);
+	}
 }
 
 static void remove_watch(DBusWatch *watch, void *data)
 {
-	int i, n;
+	struct loop_source *src = source_from_watch(watch);
+
+	if (!src)
+		return;
+
+	if (src->read_watch == watch)
+		src->read_watch = NULL;
+
+	if (src->write_watch == watch)
+		src->write_watch = NULL;
+
+	source_update(src);
+	source_release(src);
+}
+
+static dbus_bool_t add_watch(DBusWatch *watch, void *data)
+{
+	struct loop_source *src;
+	unsigned int flags = dbus_watch_get_flags(watch);
+	int fd = dbus_watch_get_unix_fd(watch);
+
+	if (!(src = source_from_fd(fd)) && !(src = source_new(fd)))
+		return FALSE;
+
+	if (flags & DBUS_WATCH_READABLE)
+		src->read_watch = watch;
+
+	if (flags & DBUS_WATCH_WRITABLE)
+		src->write_watch = watch;
+
+	if (source_update(src) < 0) {
+		remove_watch(watch, data);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void toggle_watch(DBusWatch *watch, void *data)
+{
+	struct loop_source *src = source_from_watch(watch);
+
+	if (src)
+		source_update(src);
+}
+
+int loop_add_fd(int fd, loop_fd_func_t func, void *data)
+{
+	struct loop_source *src;
+	int res;
+
+	if (!func)
+		return -EINVAL;
+
+	if (!(src = source_from_fd(fd)) && !(src = source_new(fd)))
+		return -ENOMEM;
+
+	src->func = func;
+	src->data = data;
+
+	if ((res = source_update(src)) < 0)
+		loop_remove_fd(fd);
+
+	return res;
+}
+
+void loop_remove_fd(int fd)
+{
+	struct loop_source *src = source_from_fd(fd);
+
+	if (!src)
+		return;
+
+	src->func = NULL;
+	src->data = NULL;
+	source_update(src);
+	source_release(src);
+}
+
+/*
+ * func is called when fd is writable, until loop_remove_fd_write: for the
+ * fds whose output is queued while they are full.
+ */
+int loop_add_fd_write(int fd, loop_fd_func_t func, void *data)
+{
+	struct loop_source *src;
+	int res;
+
+	if (!func)
+		return -EINVAL;
+
+	if (!(src = source_from_fd(fd)) && !(src = source_new(fd)))
+		return -ENOMEM;
+
+	src->write_func = func;
+	src->write_data = data;
+
+	if ((res = source_update(src)) < 0)
+		loop_remove_fd_write(fd);
+
+	return res;
+}
+
+void loop_remove_fd_write(int fd)
+{
+	struct loop_source *src = source_from_fd(fd);
+
+	if (!src)
+		return;
+
+	src->write_func = NULL;
+	src->write_data = NULL;
+	source_update(src);
+	source_release(src);
+}
+
+/*
+ * The timers (loop_add_timer and the dbus timeouts) are a min-heap of
+ * deadlines, the first one is the timeout of epoll_wait.
+ */
+struct loop_timer {
+	int id;
+	uint64_t deadline;	// ms, CLOCK_MONOTONIC
+	unsigned int interval;
+	loop_timer_func_t func;
+	void *data;
+	unsigned int heap_pos;
+	bool removed;		// while its func runs
+};
+
+static __thread struct loop_timer **timers;
+static __thread unsigned int timers_count;
+static __thread unsigned int timers_size;
+static __thread struct loop_timer *running_timer;
+static __thread int last_timer_id;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t now_ms(void)
+{
+	return now_us() / 1000;
+}
+
+static void heap_set(unsigned int pos, struct loop_timer *timer)
+{
+	timers[pos] = timer;
+	timer->heap_pos = pos;
+}
 
-	n = watcheds_count;
+static void heap_up(unsigned int pos)
+{
+	struct loop_timer *timer = timers[pos];
+	unsigned int parent;
 
-	for (i = 0; i < n; i++) {
-		if (watcheds[i] == watch) {
-			watcheds_count = --n;
-			watcheds[i] = watcheds[watcheds_count];
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+
+		if (timers[parent]->deadline <= timer->deadline)
 			break;
+
+		heap_set(pos, timers[parent]);
+		pos = parent;
+	}
+
+	heap_set(pos, timer);
+}
+
+static void heap_down(unsigned int pos)
+{
+	struct loop_timer *timer = timers[pos];
+	unsigned int child;
+
+	while ((child = 2 * pos + 1) < timers_count) {
+		if (child + 1 < timers_count && timers[child + 1]->deadline <
+				timers[child]->deadline)
+			child++;
+
+		if (timer->deadline <= timers[child]->deadline)
+			break;
+
+		heap_set(pos, timers[child]);
+		pos = child;
+	}
+
+	heap_set(pos, timer);
+}
+
+static int heap_insert(struct loop_timer *timer)
+{
+	struct loop_timer **tmp;
+
+	if (timers_count == timers_size) {
+		tmp = realloc(timers, (timers_size ? timers_size * 2 : 16) *
+				sizeof(struct loop_timer *));
+
+		if (!tmp)
+			return -ENOMEM;
+
+		timers = tmp;
+		timers_size = timers_size ? timers_size * 2 : 16;
+	}
+
+	heap_set(timers_count++, timer);
+	heap_up(timer->heap_pos);
+
+	return 0;
+}
+
+static void heap_delete(struct loop_timer *timer)
+{
+	unsigned int pos = timer->heap_pos;
+	struct loop_timer *last;
+
+	if (--timers_count == pos)
+		return;
+
+	last = timers[timers_count];
+	heap_set(pos, last);
+	heap_down(pos);
+	heap_up(last->heap_pos);
+}
+
+static struct loop_timer* timer_new(unsigned int interval,
+		loop_timer_func_t func, void *data)
+{
+	struct loop_timer *timer = calloc(1, sizeof(struct loop_timer));
+
+	if (!timer)
+		return NULL;
+
+	if (++last_timer_id <= 0)
+		last_timer_id = 1;
+
+	timer->id = last_timer_id;
+	timer->interval = interval;
+	timer->deadline = now_ms() + interval;
+	timer->func = func;
+	timer->data = data;
+
+	if (heap_insert(timer) < 0) {
+		free(timer);
+		return NULL;
+	}
+
+	return timer;
+}
+
+static void timer_free(struct loop_timer *timer)
+{
+	// it leaves the heap when its func runs, see timers_run
+	if (timer == running_timer) {
+		timer->removed = true;
+		return;
+	}
+
+	heap_delete(timer);
+	free(timer);
+}
+
+/*
+ * func is called every interval ms as long as it returns true. Returns the
+ * id of the timer (for loop_remove_timer) or -errno.
+ */
+int loop_add_timer(unsigned int interval, loop_timer_func_t func, void *data)
+{
+	struct loop_timer *timer;
+
+	if (!func)
+		return -EINVAL;
+
+	if (!(timer = timer_new(interval, func, data)))
+		return -ENOMEM;
+
+	return timer->id;
+}
+
+void loop_remove_timer(int id)
+{
+	unsigned int i;
+
+	if (running_timer && running_timer->id == id) {
+		running_timer->removed = true;
+		return;
+	}
+
+	for (i = 0; i < timers_count; i++) {
+		if (timers[i]->id == id) {
+			timer_free(timers[i]);
+			return;
+		}
+	}
+}
+
+// the timeout of epoll_wait
+static int timers_next_timeout(void)
+{
+	uint64_t now;
+
+	if (timers_count == 0)
+		return -1;
+
+	now = now_ms();
+
+	if (timers[0]->deadline <= now)
+		return 0;
+
+	return timers[0]->deadline - now;
+}
+
+/*
+ * Runs the expired timers, returns true if there was one.
+ */
+static bool timers_run(void)
+{
+	struct loop_timer *timer;
+	uint64_t now = now_ms();
+	bool repeat, res = false;
+
+	while (timers_count > 0 && timers[0]->deadline <= now) {
+		timer = timers[0];
+		heap_delete(timer);
+		running_timer = timer;
+		repeat = timer->func(timer->data);
+		running_timer = NULL;
+		res = true;
+
+		if (!repeat || timer->removed) {
+			free(timer);
+			continue;
 		}
+
+		// skip the deadlines missed, don't fire in a burst
+		timer->deadline += timer->interval;
+
+		if (timer->deadline <= now)
+			timer->deadline = now + (timer->interval ?
+					timer->interval : 1);
+
+		if (heap_insert(timer) < 0)
+			free(timer);
 	}
+
+	return res;
 }
 
+static bool dbus_timeout_expired(void *data)
+{
+	dbus_timeout_handle(data);
+
+	return true;
+}
+
+static dbus_bool_t add_timeout(DBusTimeout *timeout, void *data)
+{
+	struct loop_timer *timer;
+
+	if (!dbus_timeout_get_enabled(timeout))
+		return TRUE;
+
+	timer = timer_new(dbus_timeout_get_interval(timeout),
+			dbus_timeout_expired, timeout);
+
+	if (!timer)
+		return FALSE;
+
+	dbus_timeout_set_data(timeout, timer, NULL);
+
+	return TRUE;
+}
+
+static void remove_timeout(DBusTimeout *timeout, void *data)
+{
+	struct loop_timer *timer = dbus_timeout_get_data(timeout);
+
+	if (!timer)
+		return;
+
+	dbus_timeout_set_data(timeout, NULL, NULL);
+	timer_free(timer);
+}
+
+// the interval restarts, like when the timeout is added again
+static void toggle_timeout(DBusTimeout *timeout, void *data)
+{
+	remove_timeout(timeout, data);
+	add_timeout(timeout, data);
+}
+
+/*
+ * Attaches the dbus connection to the loop of the calling thread. engine_init
+ * and its users both call it: dbus would add the watches again before
+ * removing the old ones, which unregisters them.
+ */
 void loop_init(void)
 {
+	if (epoll_fd < 0)
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	// without dbus, only the fds and the timers
+	if (attached || !connection)
+		return;
+
 	dbus_connection_set_watch_functions(connection, add_watch, remove_watch,
-			NULL, NULL, NULL);
+			toggle_watch, NULL, NULL);
+	dbus_connection_set_timeout_functions(connection, add_timeout,
+			remove_timeout, toggle_timeout, NULL, NULL);
+	attached = true;
+
+	// what the previous loop left in the queue
+	dispatch_pending = true;
+}
+
+/*
+ * Removes the watches and the dbus timeouts from the loop of the calling
+ * thread, another thread can then attach the connection to its loop.
+ */
+void loop_detach(void)
+{
+	if (!attached)
+		return;
+
+	dbus_connection_set_watch_functions(connection, NULL, NULL, NULL,
+			NULL, NULL);
+	dbus_connection_set_timeout_functions(connection, NULL, NULL, NULL,
+			NULL, NULL);
+	attached = false;
+	dispatch_pending = false;
+}
+
+/*
+ * Frees the loop of the calling thread: its fds and its timers.
+ */
+void loop_destroy(void)
+{
+	struct loop_source *src;
+
+	while ((src = sources)) {
+		sources = src->next;
+		free(src);
+	}
+
+	free_removed_sources();
+
+	while (timers_count > 0)
+		timer_free(timers[0]);
+
+	free(timers);
+	timers = NULL;
+	timers_size = 0;
+
+	if (epoll_fd >= 0)
+		close(epoll_fd);
+
+	epoll_fd = -1;
 }
 
 void loop_terminate(void)
 {
+	loop_detach();
 	dbus_connection_unref(connection);
 	connection = 0;
-	watcheds_count = 0;
+	loop_destroy();
 }
 
 void loop_quit(void)
@@ -84,86 +683,166 @@ void loop_quit(void)
 	stop_loop = 1;
 }
 
-void loop_run(bool poll_stdin)
+// the counters of the loop of the calling thread
+void loop_get_stats(struct loop_stats *res)
 {
-	struct pollfd fds[WATCHEDS_MAX_COUNT];
-	DBusWatch *tmp_watcher;
-	int nfds, i, status, processdbus;
-	unsigned int flags;
-	short revents, cond;
+	*res = stats;
+}
 
-	while (!stop_loop) {
+/*
+ * Returns true if messages are left for the next iteration.
+ */
+static bool dispatch_budgeted(void)
+{
+	uint64_t start = now_us();
+	int i;
 
-		nfds = 0;
+	for (i = 0; i < LOOP_DISPATCH_BUDGET; i++) {
+		stats.dispatched++;
 
-		// prepare
-		for (i = 0 ; i < watcheds_count ; i++) {
-			tmp_watcher = watcheds[i];
+		if (dbus_connection_dispatch(connection) !=
+				DBUS_DISPATCH_DATA_REMAINS)
+			return false;
 
-			if (dbus_watch_get_enabled(tmp_watcher)) {
-				cond = POLLHUP | POLLERR;
-				flags = dbus_watch_get_flags(tmp_watcher);
+		if (now_us() - start >= LOOP_DISPATCH_TIME_BUDGET) {
+			stats.time_budget_hits++;
+			return true;
+		}
+	}
 
-				if (flags & DBUS_WATCH_READABLE) 
-					cond |= POLLIN;
+	stats.budget_hits++;
 
-				watcheds[nfds] = tmp_watcher;
-				fds[nfds].fd =
-					dbus_watch_get_unix_fd(tmp_watcher);
-				fds[nfds].events = cond;
+	return true;
+}
 
-				nfds++;
-			}
-		}
+static void stdin_ready(int fd, void *data)
+{
+	uint64_t start = __latency_now();
 
-		if (poll_stdin) {
-			fds[nfds].fd = 0;
-			fds[nfds].events = POLLHUP | POLLERR | POLLIN;
-			nfds++;
-		}
+	loop_stdin_callback();
+	__latency_record(LATENCY_INPUT, start);
+}
+
+static bool source_handle_watches(struct loop_source *src, uint32_t events)
+{
+	unsigned int flags = 0;
+
+	if (events & EPOLLIN)
+		flags |= DBUS_WATCH_READABLE;
+
+	if (events & EPOLLOUT)
+		flags |= DBUS_WATCH_WRITABLE;
+
+	if (events & EPOLLHUP)
+		flags |= DBUS_WATCH_HANGUP;
+
+	if (events & EPOLLERR)
+		flags |= DBUS_WATCH_ERROR;
+
+	if (src->read_watch == src->write_watch) {
+		if (!src->read_watch)
+			return false;
+
+		dbus_watch_handle(src->read_watch, flags);
+		return true;
+	}
+
+	if (src->read_watch && (flags & ~DBUS_WATCH_WRITABLE))
+		dbus_watch_handle(src->read_watch,
+				flags & ~DBUS_WATCH_WRITABLE);
+
+	// the read watch may have removed the source
+	if (!src->removed && src->write_watch &&
+			(flags & ~DBUS_WATCH_READABLE))
+		dbus_watch_handle(src->write_watch,
+				flags & ~DBUS_WATCH_READABLE);
+
+	return true;
+}
+
+void loop_run(bool poll_stdin)
+{
+	struct epoll_event events[LOOP_MAX_EVENTS];
+	struct loop_source *src;
+	int nfds, i, processdbus;
+	uint64_t wake, start;
+	bool first_watch;
+
+	if (poll_stdin && loop_stdin_callback)
+		loop_add_fd(STDIN_FILENO, stdin_ready, NULL);
+
+	while (!stop_loop) {
+
+		// leftover messages: only look at the fds, don't wait
+		nfds = epoll_wait(epoll_fd, events, LOOP_MAX_EVENTS,
+				dispatch_pending ? 0 : timers_next_timeout());
 
+		wake = __latency_now();
 
-		// poll
-		status = poll(fds, (nfds_t) nfds, -1);
-		if (status <= 0) {
-			printf("\n[-] poll error %d:%s\n", errno,
+		// SIGUSR1 (see main)
+		__latency_dump_requested();
+
+		// a signal handler calls loop_quit if it wants to stop
+		if (nfds < 0 && errno == EINTR)
+			continue;
+
+		if (nfds < 0) {
+			printf("\n[-] epoll error %d:%s\n", errno,
 					strerror(errno));
 			break;
 		}
 
-		// process
-		processdbus = 0;
+		stats.iterations++;
+		dispatching++;
+		processdbus = dispatch_pending;
+		first_watch = true;
 
-		if (poll_stdin)
-			nfds--;
+		for (i = 0; i < nfds; i++) {
+			src = events[i].data.ptr;
 
-		for (i = 0; i < nfds; ++i) {
-			revents = fds[i].revents;
-			if (revents) {
-				flags = 0;
+			if (src->removed)
+				continue;
 
-				if (revents & POLLIN)  
-					flags |= DBUS_WATCH_READABLE;
+			if (first_watch && (src->read_watch ||
+						src->write_watch)) {
+				__latency_record(LATENCY_WAKE_TO_WATCH, wake);
+				first_watch = false;
+			}
 
-				if (revents & POLLHUP) 
-					flags |= DBUS_WATCH_HANGUP;
+			if (source_handle_watches(src, events[i].events))
+				processdbus = 1;
+		}
 
-				if (revents & POLLERR) 
-					flags |= DBUS_WATCH_ERROR;
+		// a pending call that timed out gets its error reply
+		if (timers_run() && attached)
+			processdbus = 1;
 
-				dbus_watch_handle(watcheds[i], flags);
-				processdbus = 1;
-			}
+		if (processdbus && attached) {
+			start = __latency_now();
+			dispatch_pending = dispatch_budgeted();
+			__latency_record(LATENCY_DISPATCH, start);
 		}
 
-		if (processdbus) {
-			while (dbus_connection_dispatch(connection) ==
-					DBUS_DISPATCH_DATA_REMAINS);
+		// the other fds get their turn between two dbus budgets
+		for (i = 0; i < nfds; i++) {
+			src = events[i].data.ptr;
+
+			if (!src->removed && src->func &&
+					(events[i].events & ~EPOLLOUT))
+				src->func(src->fd, src->data);
+
+			if (!src->removed && src->write_func &&
+					(events[i].events & ~EPOLLIN))
+				src->write_func(src->fd, src->write_data);
 		}
-		
-		if (poll_stdin && fds[nfds].revents & POLLIN)
-			ncurses_action();
+
+		if (--dispatching == 0)
+			free_removed_sources();
 
 	} // end while
+
+	if (poll_stdin && loop_stdin_callback)
+		loop_remove_fd(STDIN_FILENO);
+
 	stop_loop = 0;
 }
@@ -24,12 +24,46 @@
 extern "C" {
 #endif
 
+struct loop_stats {
+	unsigned long iterations;
+	unsigned long dispatched;	// dbus messages
+	unsigned long budget_hits;	// dispatch stopped by the message budget
+	unsigned long time_budget_hits;	// by the time budget
+};
+
+/* called when fd is readable */
+typedef void (*loop_fd_func_t)(int fd, void *data);
+
+/* called every interval ms while it returns true */
+typedef bool (*loop_timer_func_t)(void *data);
+
+/* called by loop_run(true) when stdin is readable (the ui) */
+extern void (*loop_stdin_callback)(void);
+
 void loop_init(void);
 
+int loop_add_fd(int fd, loop_fd_func_t func, void *data);
+
+void loop_remove_fd(int fd);
+
+int loop_add_fd_write(int fd, loop_fd_func_t func, void *data);
+
+void loop_remove_fd_write(int fd);
+
+int loop_add_timer(unsigned int interval, loop_timer_func_t func, void *data);
+
+void loop_remove_timer(int id);
+
 void loop_run(bool poll_stdin);
 
 void loop_quit(void);
 
+void loop_get_stats(struct loop_stats *res);
+
+void loop_detach(void);
+
+void loop_destroy(void);
+
 void loop_terminate(void);
 
 #ifdef __cplusplus
@@ -25,7 +25,9 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 #include <dbus/dbus.h>
@@ -37,6 +39,7 @@
 #include "ncurses_utils.h"
 #include "renderers.h"
 #include "keys.h"
+#include "latency.h"
 
 /*
 
@@ -347,7 +350,28 @@ void ncurses_action(void)
 	wrefresh(win_body);
 }
 
-int main(void)
+/*
+ * ncurses draws on the terminal, the latency dumps go to
+ * $XDG_RUNTIME_DIR/connman-json-latency.log, or
+ * /tmp/connman-json-latency-<uid>.log if it isn't set.
+ */
+static const char* latency_log_path(void)
+{
+	static char path[PATH_MAX];
+	const char *base = getenv("XDG_RUNTIME_DIR");
+
+	if (base && base[0] == '/')
+		snprintf(path, sizeof(path), "%s/connman-json-latency.log",
+				base);
+	else
+		snprintf(path, sizeof(path),
+				"/tmp/connman-json-latency-%u.log",
+				(unsigned int) getuid());
+
+	return path;
+}
+
+int main(int argc, char *argv[])
 {
 	struct json_object *cmd;
 	engine_callback = main_callback;
@@ -356,8 +380,17 @@ int main(void)
 		exit(1);
 
 	signal(SIGINT, stop_loop);
+
+	// dumps the latency histograms, see latency_log_path
+	latency_dump_path = latency_log_path();
+	signal(SIGUSR1, __latency_request_dump);
 	loop_init();
 
+	// the dbus signals are handled in their own thread
+	if (argc > 1 && strcmp(argv[1], "--threaded") == 0 &&
+			engine_thread_start() < 0)
+		exit(1);
+
 	initscr();
 	cbreak();
 	noecho();
@@ -393,6 +426,7 @@ int main(void)
 	json_object_object_add(cmd, key_command, json_object_new_string("get_home_page"));
 	engine_query(cmd);
 
+	loop_stdin_callback = ncurses_action;
 	loop_run(true);
 	loop_terminate();
 
@@ -0,0 +1,136 @@
+/*
+ *  connman-json-client
+ *
+ *  Headless daemon: the engine shared by the clients of a unix socket,
+ *  see server.h.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <dbus/dbus.h>
+
+#include "dbus_json.h"
+#include "engine.h"
+#include "keys.h"
+#include "loop.h"
+#include "latency.h"
+#include "server.h"
+
+void __connman_callback_ended(void)
+{
+	// mandatory, see dbus_helpers.h
+	return;
+}
+
+static void stop_loop(int signum)
+{
+	loop_quit();
+}
+
+/*
+ * The services of ConnMan (GetServices) as json on stdout. The text is
+ * written while the reply is read, the json objects aren't built.
+ */
+static int dump_services(void)
+{
+	DBusMessage *message, *reply;
+	DBusConnection *connection;
+	DBusMessageIter iter;
+	DBusError err;
+	int res = -EINVAL;
+
+	dbus_error_init(&err);
+
+	if (!(connection = dbus_bus_get(DBUS_BUS_SYSTEM, &err))) {
+		fprintf(stderr, "[-] %s\n", err.message);
+		dbus_error_free(&err);
+		return -ECONNREFUSED;
+	}
+
+	message = dbus_message_new_method_call(key_connman_service,
+			key_connman_path, "net.connman.Manager", "GetServices");
+	reply = dbus_connection_send_with_reply_and_block(connection, message,
+			DBUS_TIMEOUT_USE_DEFAULT, &err);
+	dbus_message_unref(message);
+
+	if (!reply) {
+		fprintf(stderr, "[-] %s\n", err.message);
+		dbus_error_free(&err);
+		dbus_connection_unref(connection);
+		return -EIO;
+	}
+
+	if (dbus_message_iter_init(reply, &iter))
+		res = __connman_dbus_json_print_iter(&iter);
+
+	dbus_message_unref(reply);
+	dbus_connection_unref(connection);
+
+	return res;
+}
+
+/*
+ * connman_json_daemon [socket path]
+ * connman_json_daemon --dump
+ */
+int main(int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : __server_default_path();
+	const char *workers = getenv("CONNMAN_JSON_DECODE_WORKERS");
+	int res;
+
+	if (argc > 1 && strcmp(argv[1], "--dump") == 0)
+		return dump_services() < 0 ? 1 : 0;
+
+	engine_callback = __server_callback;
+
+	if (workers)
+		engine_decode_workers = atoi(workers);
+
+	if (engine_init() < 0)
+		exit(1);
+
+	signal(SIGINT, stop_loop);
+	signal(SIGTERM, stop_loop);
+
+	// dumps the latency histograms on stderr
+	signal(SIGUSR1, __latency_request_dump);
+
+	loop_init();
+
+	if ((res = __server_start(path)) < 0) {
+		fprintf(stderr, "[-] can't listen on %s: %s\n", path,
+				strerror(-res));
+		exit(1);
+	}
+
+	loop_run(false);
+
+	__server_stop();
+	engine_terminate();
+	loop_terminate();
+
+	return 0;
+}
@@ -75,7 +75,8 @@ static void renderers_technologies(struct json_object *jobj)
 	char *desc_base = "%-20s Powered %-5s          Connected %-5s";
 	char desc_base_sub[30];
 	const char *k_name, *k_type, *k_powered, *k_connected;
-	char *desc, *tech_short_name;
+	const char *tech_short_name;
+	char *desc;
 	struct json_object *sub_array, *tech_name, *tech_dict;
 	struct userptr_data *data;
 
@@ -185,7 +186,6 @@ void __renderers_free_home_page(void)
 
 	for (i = 0; i < nb_items; i++) {
 		free((void *) my_items[i]->description.str);
-		free((void *) my_items[i]->name.str);
 
 		data = item_userptr(my_items[i]);
 		free((void *) data->dbus_name);
@@ -419,7 +419,7 @@ static void renderers_services_wifi(struct json_object *jobj)
 
 static void renderers_services(struct json_object *jobj)
 {
-	char *dbus_short_name;
+	const char *dbus_short_name;
 	struct json_object *array, *dbus_long_name;
 	
 	nb_items = json_object_array_length(jobj);
@@ -434,18 +434,17 @@ static void renderers_services(struct json_object *jobj)
 	array = json_object_array_get_idx(jobj, 0);
 	dbus_long_name = json_object_array_get_idx(array, 0);
 
-	dbus_short_name = __extract_dbus_short_name(json_object_get_string(dbus_long_name));
+	// not __extract_dbus_short_name: services come and go, atoms stay
+	dbus_short_name = strrchr(json_object_get_string(dbus_long_name), '/');
 	my_items = calloc(nb_items+1, sizeof(ITEM *));
 	assert(my_items != NULL);
 	
-	if (strncmp(dbus_short_name, "ethernet_", 9) == 0)
+	if (strncmp(dbus_short_name, "/ethernet_", 10) == 0)
 		renderers_services_ethernet(jobj);
-	else if (strncmp(dbus_short_name, "wifi_", 5) == 0)
+	else if (strncmp(dbus_short_name, "/wifi_", 6) == 0)
 		renderers_services_wifi(jobj);
 	else
 		assert(true);
-	
-	free(dbus_short_name);
 
 	mvwprintw(win_body, 2, 3, "Choose a network to connect to:");
 
@@ -0,0 +1,948 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <json/json.h>
+
+#include "atoms.h"
+#include "cbor.h"
+#include "engine.h"
+#include "json_utils.h"
+#include "keys.h"
+#include "latency.h"
+#include "loop.h"
+
+#include "server.h"
+
+#define SERVER_BACKLOG 16
+
+/* messages written by one sendmsg */
+#define SERVER_IOV_MAX 64
+
+/*
+ * A callback serialized once, "{ status, data }\n", and shared by the
+ * queues of all the clients it goes to.
+ */
+struct server_msg {
+	unsigned int refs;
+	bool signal;
+	const char *key;	// a counted atom, see signal_key
+	uint64_t time;		// ns, when it was queued
+	size_t len;
+	char data[];
+};
+
+struct server_client {
+	int fd;
+	bool subscribed;
+	enum server_format format;
+	bool closing;		// freed once its lines are read
+	char in[SERVER_MAX_LINE];
+	size_t in_len;
+	struct server_msg **queue;	// a ring of the messages not written
+	unsigned int queue_head;
+	unsigned int queue_len;
+	unsigned int queue_size;	// a power of 2
+	size_t sent;		// bytes of the first message already written
+	size_t pending;		// bytes queued
+	unsigned long written;	// messages
+	unsigned long coalesced;
+	unsigned long dropped;
+	unsigned long serial;	// the user_data of its queries
+	struct server_client *next;
+};
+
+static int listen_fd = -1;
+static char *listen_path;
+static struct server_client *clients;
+static unsigned long last_serial;
+
+/*
+ * The client whose lines client_readable runs: a reply that overflows its
+ * queue only marks it closing, it is freed once the lines are done.
+ */
+static struct server_client *current;
+
+/*
+ * $XDG_RUNTIME_DIR/connman-json.sock, or /tmp/connman-json-<uid>.sock if
+ * it isn't set.
+ */
+const char* __server_default_path(void)
+{
+	static char path[PATH_MAX];
+	const char *base = getenv("XDG_RUNTIME_DIR");
+
+	if (base && base[0] == '/')
+		snprintf(path, sizeof(path), "%s/connman-json.sock", base);
+	else
+		snprintf(path, sizeof(path), "/tmp/connman-json-%u.sock",
+				(unsigned int) getuid());
+
+	return path;
+}
+
+/*
+ * id is the one of the query, if it had one.
+ {
+	"id": 42,
+	"status": 0,
+	"data": { ... }
+ }
+ */
+static struct json_object* reply_new(unsigned int id, int status,
+		struct json_object *jobj)
+{
+	struct json_object *res = json_object_new_object();
+
+	if (id)
+		json_object_object_add(res, key_command_id,
+				json_object_new_int64(id));
+
+	json_object_object_add(res, "status", json_object_new_int(status));
+	json_object_object_add(res, "data", jobj);
+
+	return res;
+}
+
+static struct server_msg* msg_alloc(size_t len, bool signal, const char *key)
+{
+	struct server_msg *msg = malloc(sizeof(struct server_msg) + len);
+
+	if (!msg)
+		return NULL;
+
+	msg->refs = 1;
+	msg->signal = signal;
+	msg->key = __atom_dup(key);
+	msg->time = __latency_now();
+	msg->len = len;
+
+	return msg;
+}
+
+// the json text and a new line
+static struct server_msg* msg_new_json(struct json_object *reply,
+		bool signal, const char *key)
+{
+	const char *str = json_object_to_json_string(reply);
+	size_t len = strlen(str);
+	struct server_msg *msg;
+
+	if ((msg = msg_alloc(len + 1, signal, key))) {
+		memcpy(msg->data, str, len);
+		msg->data[len] = '\n';
+	}
+
+	return msg;
+}
+
+// the length of the cbor (4 bytes, big endian) and the cbor
+static struct server_msg* msg_new_cbor(struct json_object *reply,
+		bool signal, const char *key)
+{
+	struct cbor_buffer buf = { NULL, 0, 0 };
+	struct server_msg *msg = NULL;
+
+	if (__cbor_encode(&buf, reply) == 0 && buf.len <= UINT32_MAX &&
+			(msg = msg_alloc(buf.len + 4, signal, key))) {
+		msg->data[0] = buf.len >> 24;
+		msg->data[1] = buf.len >> 16;
+		msg->data[2] = buf.len >> 8;
+		msg->data[3] = buf.len;
+		memcpy(msg->data + 4, buf.data, buf.len);
+	}
+
+	__cbor_buffer_free(&buf);
+
+	return msg;
+}
+
+static struct server_msg* msg_new(struct json_object *reply,
+		enum server_format format, bool signal, const char *key)
+{
+	if (format == SERVER_FORMAT_CBOR)
+		return msg_new_cbor(reply, signal, key);
+
+	return msg_new_json(reply, signal, key);
+}
+
+static void msg_unref(struct server_msg *msg)
+{
+	if (--msg->refs > 0)
+		return;
+
+	__atom_unref(msg->key);
+	free(msg);
+}
+
+static struct server_msg** queue_at(struct server_client *client,
+		unsigned int i)
+{
+	return &client->queue[(client->queue_head + i) &
+		(client->queue_size - 1)];
+}
+
+static struct server_msg* queue_first(struct server_client *client)
+{
+	return client->queue[client->queue_head];
+}
+
+static void queue_pop(struct server_client *client)
+{
+	struct server_msg *msg = queue_first(client);
+
+	client->pending -= msg->len - client->sent;
+	client->sent = 0;
+	client->queue_head = (client->queue_head + 1) &
+		(client->queue_size - 1);
+	client->queue_len--;
+	msg_unref(msg);
+}
+
+static int queue_grow(struct server_client *client)
+{
+	unsigned int size = client->queue_size ? client->queue_size * 2 : 16;
+	struct server_msg **queue;
+	unsigned int i;
+
+	if (!(queue = malloc(size * sizeof(struct server_msg *))))
+		return -ENOMEM;
+
+	for (i = 0; i < client->queue_len; i++)
+		queue[i] = *queue_at(client, i);
+
+	free(client->queue);
+	client->queue = queue;
+	client->queue_head = 0;
+	client->queue_size = size;
+
+	return 0;
+}
+
+/*
+ * The engine builds the json of the signals only if a client subscribed to
+ * them.
+ */
+static void subscribers_changed(void)
+{
+	struct server_client *client;
+
+	for (client = clients; client; client = client->next)
+		if (client->subscribed)
+			break;
+
+	engine_subscribe_signals(client != NULL);
+}
+
+static void client_free(struct server_client *client)
+{
+	struct server_client **pos;
+
+	if (client == current) {
+		client->closing = true;
+		return;
+	}
+
+	for (pos = &clients; *pos; pos = &(*pos)->next) {
+		if (*pos == client) {
+			*pos = client->next;
+			break;
+		}
+	}
+
+	loop_remove_fd(client->fd);
+	loop_remove_fd_write(client->fd);
+	close(client->fd);
+
+	while (client->queue_len > 0)
+		queue_pop(client);
+
+	free(client->queue);
+
+	if (client->subscribed)
+		subscribers_changed();
+
+	free(client);
+}
+
+/*
+ * Writes what it can of the queue, the messages straight from their shared
+ * buffers. Returns -errno on error.
+ */
+static int client_flush(struct server_client *client)
+{
+	struct iovec iov[SERVER_IOV_MAX];
+	struct server_msg *msg;
+	struct msghdr hdr;
+	unsigned int i, n;
+	ssize_t len;
+	size_t written;
+
+	while (client->queue_len > 0) {
+		n = client->queue_len < SERVER_IOV_MAX ? client->queue_len :
+			SERVER_IOV_MAX;
+
+		for (i = 0; i < n; i++) {
+			msg = *queue_at(client, i);
+			iov[i].iov_base = msg->data;
+			iov[i].iov_len = msg->len;
+		}
+
+		iov[0].iov_base = queue_first(client)->data + client->sent;
+		iov[0].iov_len -= client->sent;
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_iov = iov;
+		hdr.msg_iovlen = n;
+		len = sendmsg(client->fd, &hdr, MSG_NOSIGNAL);
+
+		if (len < 0 && errno == EINTR)
+			continue;
+
+		if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+
+		if (len < 0)
+			return -errno;
+
+		written = client->sent + len;
+
+		while (client->queue_len > 0 &&
+				written >= queue_first(client)->len) {
+			written -= queue_first(client)->len;
+			queue_pop(client);
+			client->written++;
+		}
+
+		if (client->queue_len > 0) {
+			client->pending -= written - client->sent;
+			client->sent = written;
+		}
+	}
+
+	return 0;
+}
+
+static void client_writable(int fd, void *data)
+{
+	struct server_client *client = data;
+
+	if (client_flush(client) < 0) {
+		client_free(client);
+		return;
+	}
+
+	if (client->queue_len == 0)
+		loop_remove_fd_write(fd);
+}
+
+/*
+ * Replaces the last pending message with the same key as msg, except the
+ * one being written. Returns false if there isn't any.
+ */
+static bool queue_coalesce(struct server_client *client,
+		struct server_msg *msg)
+{
+	unsigned int i, first = client->sent ? 1 : 0;
+	struct server_msg *old;
+
+	if (!msg->key)
+		return false;
+
+	for (i = client->queue_len; i-- > first;) {
+		old = *queue_at(client, i);
+
+		if (old->key != msg->key)
+			continue;
+
+		msg->refs++;
+		*queue_at(client, i) = msg;
+		client->pending = client->pending - old->len + msg->len;
+		msg_unref(old);
+
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Removes the messages made stale by a later one with the same key, except
+ * the one being written. Returns the number removed.
+ */
+static unsigned int queue_compact(struct server_client *client)
+{
+	unsigned int i, j, first = client->sent ? 1 : 0;
+	unsigned int kept = client->queue_len, removed;
+	struct server_msg *msg;
+
+	// the kept messages are packed at the end, in order
+	for (i = client->queue_len; i-- > first;) {
+		msg = *queue_at(client, i);
+
+		for (j = kept; msg->key && j < client->queue_len; j++)
+			if ((*queue_at(client, j))->key == msg->key)
+				break;
+
+		if (msg->key && j < client->queue_len) {
+			client->pending -= msg->len;
+			msg_unref(msg);
+			continue;
+		}
+
+		*queue_at(client, --kept) = msg;
+	}
+
+	removed = kept - first;
+
+	if (first && removed)
+		*queue_at(client, kept - 1) = *queue_at(client, 0);
+
+	client->queue_head = (client->queue_head + removed) &
+		(client->queue_size - 1);
+	client->queue_len -= removed;
+
+	return removed;
+}
+
+/*
+ * The queue is written when the loop sees the socket writable: all the
+ * messages of a loop iteration go in one sendmsg.
+ *
+ * A client that doesn't keep up gets at most SERVER_MAX_QUEUE signals
+ * queued: then a signal replaces the pending one of the same property (a
+ * stale Strength...), or the stale messages are removed to make room. It
+ * is dropped only if there are none. The replies are always queued, up to
+ * SERVER_MAX_PENDING bytes: a message alone in the queue is taken whatever
+ * its size (the services, with thousands of them), the cap is on what
+ * piles up behind it.
+ */
+static void client_queue(struct server_client *client,
+		struct server_msg *msg)
+{
+	unsigned int removed;
+
+	if (client->closing)
+		return;
+
+	if (msg->signal && client->queue_len >= SERVER_MAX_QUEUE) {
+		if (queue_coalesce(client, msg)) {
+			client->coalesced++;
+			return;
+		}
+
+		removed = queue_compact(client);
+		client->coalesced += removed;
+
+		if (!removed) {
+			client->dropped++;
+			return;
+		}
+	}
+
+	if ((client->queue_len &&
+			client->pending + msg->len > SERVER_MAX_PENDING) ||
+			(client->queue_len == client->queue_size &&
+			 queue_grow(client) < 0)) {
+		client_free(client);
+		return;
+	}
+
+	msg->refs++;
+	client->queue[(client->queue_head + client->queue_len) &
+		(client->queue_size - 1)] = msg;
+	client->queue_len++;
+	client->pending += msg->len;
+
+	if (client->queue_len == 1 && loop_add_fd_write(client->fd,
+				client_writable, client) < 0)
+		client_free(client);
+}
+
+static void client_reply(struct server_client *client, unsigned int id,
+		int status, struct json_object *jobj)
+{
+	struct json_object *reply = reply_new(id, status, jobj);
+	struct server_msg *msg;
+
+	if ((msg = msg_new(reply, client->format,
+					status == ENGINE_SIGNAL_STATUS, NULL))) {
+		client_queue(client, msg);
+		msg_unref(msg);
+	}
+
+	json_object_put(reply);
+}
+
+/*
+ {
+	"ERROR": [ "connect: error -22" ]
+ }
+ */
+static void client_reply_error(struct server_client *client, unsigned int id,
+		const char *command, int res)
+{
+	struct json_object *jobj, *array;
+	char msg[64];
+
+	snprintf(msg, sizeof(msg), "%s: error %d", command, res);
+	array = json_object_new_array();
+	json_object_array_add(array, json_object_new_string(msg));
+	jobj = json_object_new_object();
+	json_object_object_add(jobj, key_dbus_json_error_key, array);
+	client_reply(client, id, res, jobj);
+}
+
+static void client_subscribe(struct server_client *client, unsigned int id,
+		const char *command, bool subscribed)
+{
+	struct json_object *jobj = json_object_new_object();
+
+	client->subscribed = subscribed;
+	subscribers_changed();
+	json_object_object_add(jobj, key_command,
+			json_object_new_string(command));
+	client_reply(client, id, 0, jobj);
+}
+
+/*
+ * The queue of each client, lag_us is the age of its oldest message.
+ {
+	"command": "get_server_stats",
+	"cmd_data": {
+		"clients": [
+			{
+				"subscribed": true,
+				"queued": 12,
+				"queued_bytes": 3456,
+				"lag_us": 1234,
+				"written": 5678,
+				"coalesced": 56,
+				"dropped": 7
+			}
+		]
+	}
+ }
+ */
+static void client_stats(struct server_client *client, unsigned int id,
+		const char *command)
+{
+	struct json_object *res, *array, *jclient;
+	struct server_client *tmp;
+	uint64_t now = __latency_now();
+
+	array = json_object_new_array();
+
+	for (tmp = clients; tmp; tmp = tmp->next) {
+		jclient = json_object_new_object();
+		json_object_object_add(jclient, "subscribed",
+				json_object_new_boolean(tmp->subscribed));
+		json_object_object_add(jclient, "queued",
+				json_object_new_int(tmp->queue_len));
+		json_object_object_add(jclient, "queued_bytes",
+				json_object_new_int64(tmp->pending));
+		json_object_object_add(jclient, "lag_us",
+				json_object_new_int64(tmp->queue_len ?
+					(now - queue_first(tmp)->time) / 1000 :
+					0));
+		json_object_object_add(jclient, "written",
+				json_object_new_int64(tmp->written));
+		json_object_object_add(jclient, "coalesced",
+				json_object_new_int64(tmp->coalesced));
+		json_object_object_add(jclient, "dropped",
+				json_object_new_int64(tmp->dropped));
+		json_object_array_add(array, jclient);
+	}
+
+	res = json_object_new_object();
+	json_object_object_add(res, "clients", array);
+	jclient = json_object_new_object();
+	json_object_object_add(jclient, key_command,
+			json_object_new_string(command));
+	json_object_object_add(jclient, key_command_data, res);
+	client_reply(client, id, 0, jclient);
+}
+
+/*
+ {
+	"command": "set_format",
+	"cmd_data": { "format": "cbor" }
+ }
+ */
+static int client_set_format(struct server_client *client, unsigned int id,
+		struct json_object *jobj, const char *command)
+{
+	struct json_object *data, *format, *res;
+	const char *format_str;
+
+	if (!json_object_object_get_ex(jobj, key_command_data, &data) ||
+			!json_object_object_get_ex(data, "format", &format) ||
+			!(format_str = json_object_get_string(format)))
+		return -EINVAL;
+
+	if (strcmp(format_str, "json") == 0)
+		client->format = SERVER_FORMAT_JSON;
+	else if (strcmp(format_str, "cbor") == 0)
+		client->format = SERVER_FORMAT_CBOR;
+	else
+		return -EINVAL;
+
+	res = json_object_new_object();
+	json_object_object_add(res, key_command,
+			json_object_new_string(command));
+	client_reply(client, id, 0, res);
+
+	return 0;
+}
+
+// the client may be gone when the reply comes
+static void client_query_reply(unsigned int id, int status,
+		struct json_object *jobj, void *user_data)
+{
+	unsigned long serial = (uintptr_t) user_data;
+	struct server_client *client;
+
+	for (client = clients; client; client = client->next)
+		if (client->serial == serial)
+			break;
+
+	if (!client || client->closing) {
+		json_object_put(jobj);
+		return;
+	}
+
+	client_reply(client, id, status, jobj);
+}
+
+// the "id" of the query, 0 if it has none or it isn't valid
+static unsigned int query_id(struct json_object *jobj)
+{
+	struct json_object *jid;
+	int64_t id;
+
+	if (!json_object_object_get_ex(jobj, key_command_id, &jid) ||
+			json_object_get_type(jid) != json_type_int)
+		return 0;
+
+	id = json_object_get_int64(jid);
+
+	return (id > 0 && id <= UINT32_MAX) ? id : 0;
+}
+
+static void client_query(struct server_client *client, const char *line)
+{
+	struct json_object *jobj = json_tokener_parse(line);
+	const char *command_str;
+	char command[64];
+	unsigned int id;
+	int res;
+
+	if (!jobj || json_object_get_type(jobj) != json_type_object) {
+		json_object_put(jobj);
+		client_reply_error(client, 0, "json", -EINVAL);
+		return;
+	}
+
+	id = query_id(jobj);
+	command_str = __json_get_command_str(jobj);
+	snprintf(command, sizeof(command), "%s",
+			command_str ? command_str : "command");
+
+	if (strcmp(command, "subscribe") == 0 ||
+			strcmp(command, "unsubscribe") == 0) {
+		client_subscribe(client, id, command, command[0] == 's');
+		json_object_put(jobj);
+		return;
+	}
+
+	if (strcmp(command, "get_server_stats") == 0) {
+		client_stats(client, id, command);
+		json_object_put(jobj);
+		return;
+	}
+
+	if (strcmp(command, "set_format") == 0) {
+		if ((res = client_set_format(client, id, jobj, command)) < 0)
+			client_reply_error(client, id, command, res);
+
+		json_object_put(jobj);
+		return;
+	}
+
+	res = engine_query_full(jobj, client_query_reply,
+			(void *) (uintptr_t) client->serial);
+
+	if (res < 0 && res != -EINPROGRESS)
+		client_reply_error(client, id, command, res);
+}
+
+static void client_readable(int fd, void *data)
+{
+	struct server_client *client = data;
+	char *line, *end;
+	ssize_t len;
+
+	len = read(fd, client->in + client->in_len,
+			sizeof(client->in) - client->in_len);
+
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+
+	if (len <= 0) {
+		client_free(client);
+		return;
+	}
+
+	client->in_len += len;
+	line = client->in;
+	current = client;
+
+	while (!client->closing && (end = memchr(line, '\n',
+					client->in_len - (line - client->in)))) {
+		*end = '\0';
+
+		if (end > line)
+			client_query(client, line);
+
+		line = end + 1;
+	}
+
+	current = NULL;
+
+	if (client->closing) {
+		client_free(client);
+		return;
+	}
+
+	client->in_len -= line - client->in;
+	memmove(client->in, line, client->in_len);
+
+	// a line can't be longer than the buffer
+	if (client->in_len == sizeof(client->in))
+		client_free(client);
+}
+
+static void server_accept(int fd, void *data)
+{
+	struct server_client *client;
+	int client_fd;
+
+	while ((client_fd = accept4(fd, NULL, NULL,
+					SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		if (!(client = calloc(1, sizeof(struct server_client)))) {
+			close(client_fd);
+			continue;
+		}
+
+		client->fd = client_fd;
+		client->serial = ++last_serial;
+
+		if (loop_add_fd(client_fd, client_readable, client) < 0) {
+			close(client_fd);
+			free(client);
+			continue;
+		}
+
+		client->next = clients;
+		clients = client;
+	}
+}
+
+/*
+ * "Service/wifi_..._managed_psk/Strength" for a PropertyChanged: a newer
+ * one makes the pending one stale. NULL for the other signals, the caller
+ * releases it with __atom_unref.
+ */
+static const char* signal_key(struct json_object *jobj)
+{
+	struct json_object *sig, *interface, *path, *data;
+	const char *interface_str, *path_str, *name;
+
+	if (!json_object_object_get_ex(jobj, key_dbus_json_signal_key, &sig) ||
+			strcmp(json_object_get_string(sig),
+				"PropertyChanged") != 0)
+		return NULL;
+
+	json_object_object_get_ex(jobj, key_command_interface, &interface);
+	json_object_object_get_ex(jobj, key_command_path, &path);
+	json_object_object_get_ex(jobj, key_command_data, &data);
+
+	if (json_object_get_type(data) != json_type_array)
+		return NULL;
+
+	interface_str = json_object_get_string(interface);
+	path_str = json_object_get_string(path);
+	name = json_object_get_string(json_object_array_get_idx(data, 0));
+
+	if (!interface_str || !path_str || !name)
+		return NULL;
+
+	return __atom_ref_printf("%s/%s/%s", interface_str, path_str, name);
+}
+
+/*
+ * The replies to the queries go to the client that asked (see
+ * client_query_reply), the signals to the subscribed clients. What is left
+ * (agent, errors of the engine) goes to every client.
+ */
+void __server_callback(int status, struct json_object *jobj)
+{
+	struct server_msg *msgs[NB_SERVER_FORMATS] = { NULL };
+	bool signal = status == ENGINE_SIGNAL_STATUS;
+	struct server_client *client, *next;
+	struct json_object *reply;
+	const char *key;
+	int i;
+
+	for (client = clients; client; client = client->next)
+		if (!signal || client->subscribed)
+			break;
+
+	// nobody listens, it isn't even serialized
+	if (!client) {
+		json_object_put(jobj);
+		return;
+	}
+
+	key = signal ? signal_key(jobj) : NULL;
+	reply = reply_new(0, status, jobj);
+
+	// serialized once per format
+	for (; client; client = next) {
+		next = client->next;
+
+		if (signal && !client->subscribed)
+			continue;
+
+		if (!msgs[client->format] && !(msgs[client->format] =
+					msg_new(reply, client->format, signal,
+						key)))
+			continue;
+
+		client_queue(client, msgs[client->format]);
+	}
+
+	for (i = 0; i < NB_SERVER_FORMATS; i++)
+		if (msgs[i])
+			msg_unref(msgs[i]);
+
+	__atom_unref(key);
+	json_object_put(reply);
+}
+
+// fails with -EADDRINUSE if another daemon listens on path
+static int check_stale(struct sockaddr_un *addr)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), res = 0;
+
+	if (fd < 0)
+		return -errno;
+
+	if (connect(fd, (struct sockaddr *) addr, sizeof(*addr)) == 0)
+		res = -EADDRINUSE;
+	else if (errno == ECONNREFUSED)
+		unlink(addr->sun_path);
+
+	close(fd);
+
+	return res;
+}
+
+/*
+ * Listens on path, only for the user (mode 0600).
+ */
+int __server_start(const char *path)
+{
+	struct sockaddr_un addr;
+	mode_t mask;
+	int res;
+
+	if (!path || strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if ((res = check_stale(&addr)) < 0)
+		return res;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+			SOCK_CLOEXEC, 0);
+
+	if (listen_fd < 0)
+		return -errno;
+
+	mask = umask(0077);
+	res = bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr));
+	umask(mask);
+
+	if (res < 0 || listen(listen_fd, SERVER_BACKLOG) < 0) {
+		res = -errno;
+		close(listen_fd);
+		listen_fd = -1;
+		return res;
+	}
+
+	listen_path = strdup(path);
+
+	if ((res = loop_add_fd(listen_fd, server_accept, NULL)) < 0) {
+		__server_stop();
+		return res;
+	}
+
+	subscribers_changed();
+
+	return 0;
+}
+
+void __server_stop(void)
+{
+	while (clients)
+		client_free(clients);
+
+	if (listen_fd >= 0) {
+		loop_remove_fd(listen_fd);
+		close(listen_fd);
+	}
+
+	if (listen_path)
+		unlink(listen_path);
+
+	free(listen_path);
+	listen_path = NULL;
+	listen_fd = -1;
+}
@@ -0,0 +1,74 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_SERVER_H
+#define __CONNMAN_SERVER_H
+
+#include <json/json.h>
+
+/* the longest command a client can send */
+#define SERVER_MAX_LINE 16384
+/* signals queued for a client, the next ones are coalesced or dropped */
+#define SERVER_MAX_QUEUE 256
+/* a client that lets more output pile up behind a message is disconnected */
+#define SERVER_MAX_PENDING (1 << 20)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The daemon mode: local clients connect to a unix socket and share the
+ * engine. They send one command per line, in the json of engine_query:
+ *
+ *	{ "command": "get_home_page" }
+ *
+ * and get one json per line back, status and data of engine_callback:
+ *
+ *	{ "status": 0, "data": { "command": "get_home_page", ... } }
+ *
+ * A query can carry an "id" (a positive integer), its reply has the same:
+ * the replies don't always come in the order of the queries.
+ *
+ * "subscribe" and "unsubscribe" (handled by the server) start and stop the
+ * signals for the client, "get_server_stats" gives the state of the queue
+ * of each client. "set_format" switches what the client gets to cbor, see
+ * server_format.
+ */
+
+enum server_format {
+	SERVER_FORMAT_JSON,	// json text, one per line
+	SERVER_FORMAT_CBOR,	// the length (4 bytes, big endian), the cbor
+	NB_SERVER_FORMATS,
+};
+
+const char* __server_default_path(void);
+
+int __server_start(const char *path);
+
+void __server_stop(void);
+
+/* the engine_callback of the daemon */
+void __server_callback(int status, struct json_object *jobj);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
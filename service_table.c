@@ -0,0 +1,1003 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <json/json.h>
+#include <dbus/dbus.h>
+
+#include "atoms.h"
+#include "dbus_json.h"
+#include "service_table.h"
+
+#define SERVICE_TABLE_MIN_CAPACITY 32
+
+/* a thread of __service_table_load_dbus loads that many services at least */
+#define SERVICE_TABLE_MIN_CHUNK 128
+
+static const char *type_names[] = {
+	[SERVICE_TYPE_UNKNOWN] = NULL,
+	[SERVICE_TYPE_SYSTEM] = "system",
+	[SERVICE_TYPE_ETHERNET] = "ethernet",
+	[SERVICE_TYPE_WIFI] = "wifi",
+	[SERVICE_TYPE_BLUETOOTH] = "bluetooth",
+	[SERVICE_TYPE_CELLULAR] = "cellular",
+	[SERVICE_TYPE_GPS] = "gps",
+	[SERVICE_TYPE_VPN] = "vpn",
+	[SERVICE_TYPE_GADGET] = "gadget",
+	[SERVICE_TYPE_P2P] = "p2p",
+};
+
+static const char *state_names[] = {
+	[SERVICE_STATE_UNKNOWN] = NULL,
+	[SERVICE_STATE_IDLE] = "idle",
+	[SERVICE_STATE_FAILURE] = "failure",
+	[SERVICE_STATE_ASSOCIATION] = "association",
+	[SERVICE_STATE_CONFIGURATION] = "configuration",
+	[SERVICE_STATE_READY] = "ready",
+	[SERVICE_STATE_DISCONNECT] = "disconnect",
+	[SERVICE_STATE_ONLINE] = "online",
+};
+
+/* in the order of enum service_security */
+static const char *security_names[] = {
+	"none", "wep", "psk", "ieee8021x", "wps", "wps_advertising", NULL,
+};
+
+static int enum_from_str(const char **names, int nb_names, const char *str)
+{
+	int i;
+
+	if (!str)
+		return 0;
+
+	for (i = 1; i < nb_names; i++)
+		if (strcmp(names[i], str) == 0)
+			return i;
+
+	return 0;
+}
+
+enum service_type __service_type_from_str(const char *str)
+{
+	return enum_from_str(type_names, sizeof(type_names) /
+			sizeof(type_names[0]), str);
+}
+
+const char* __service_type_str(enum service_type type)
+{
+	return type_names[type];
+}
+
+enum service_state __service_state_from_str(const char *str)
+{
+	return enum_from_str(state_names, sizeof(state_names) /
+			sizeof(state_names[0]), str);
+}
+
+const char* __service_state_str(enum service_state state)
+{
+	return state_names[state];
+}
+
+bool __service_state_is_connected(enum service_state state)
+{
+	return state == SERVICE_STATE_READY || state == SERVICE_STATE_ONLINE;
+}
+
+// "psk" -> SERVICE_SECURITY_PSK, -1 if unknown
+static int security_from_str(const char *str)
+{
+	int i;
+
+	for (i = 0; str && security_names[i]; i++)
+		if (strcmp(security_names[i], str) == 0)
+			return 1 << i;
+
+	return -1;
+}
+
+/*
+ * [ "psk", "wps" ] -> SERVICE_SECURITY_PSK | SERVICE_SECURITY_WPS
+ * -1 if one of the values is unknown.
+ */
+static int security_from_json(struct json_object *jarray)
+{
+	int i, len, tmp, res = 0;
+
+	if (!json_object_is_type(jarray, json_type_array))
+		return -1;
+
+	len = json_object_array_length(jarray);
+
+	for (i = 0; i < len; i++) {
+		tmp = security_from_str(json_object_get_string(
+					json_object_array_get_idx(jarray, i)));
+
+		if (tmp < 0)
+			return -1;
+
+		res |= tmp;
+	}
+
+	return res;
+}
+
+// the same for the iter of an "as"
+static int security_from_iter(DBusMessageIter *iter)
+{
+	DBusMessageIter array;
+	const char *str;
+	int tmp, res = 0;
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY ||
+			dbus_message_iter_get_element_type(iter) !=
+			DBUS_TYPE_STRING)
+		return -1;
+
+	dbus_message_iter_recurse(iter, &array);
+
+	for (; dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRING;
+			dbus_message_iter_next(&array)) {
+		dbus_message_iter_get_basic(&array, &str);
+
+		if ((tmp = security_from_str(str)) < 0)
+			return -1;
+
+		res |= tmp;
+	}
+
+	return res;
+}
+
+static struct json_object* security_to_json(uint8_t security)
+{
+	struct json_object *res = json_object_new_array();
+	int i;
+
+	for (i = 0; security_names[i]; i++)
+		if (security & (1 << i))
+			json_object_array_add(res,
+					json_object_new_string(security_names[i]));
+
+	return res;
+}
+
+/*
+ * The values of Type, State and Security stay atoms, so that the json of
+ * the services shares them (see dbus_basic_json).
+ */
+static void intern_names(const char **names, int nb_names)
+{
+	int i;
+
+	for (i = 0; i < nb_names; i++)
+		__atom_intern(names[i]);
+}
+
+struct service_table* __service_table_new(void)
+{
+	struct service_table *table;
+
+	table = calloc(1, sizeof(struct service_table));
+	assert(table != NULL);
+
+	intern_names(type_names, sizeof(type_names) / sizeof(type_names[0]));
+	intern_names(state_names, sizeof(state_names) /
+			sizeof(state_names[0]));
+	intern_names(security_names, sizeof(security_names) /
+			sizeof(security_names[0]));
+
+	return table;
+}
+
+// the path and the name are counted atoms, see __atom_ref
+static void row_release(struct service_table *table, unsigned int row)
+{
+	__atom_unref(table->path[row]);
+	__atom_unref(table->name[row]);
+	json_object_put(table->extra[row]);
+}
+
+void __service_table_clear(struct service_table *table)
+{
+	unsigned int i;
+
+	for (i = 0; i < table->count; i++)
+		row_release(table, i);
+
+	table->count = 0;
+
+	if (table->index)
+		memset(table->index, 0, table->index_size *
+				sizeof(unsigned int));
+}
+
+void __service_table_free(struct service_table *table)
+{
+	if (!table)
+		return;
+
+	__service_table_clear(table);
+
+	free(table->path);
+	free(table->name);
+	free(table->type);
+	free(table->state);
+	free(table->security);
+	free(table->strength);
+	free(table->flags);
+	free(table->extra);
+	free(table->index);
+	free(table);
+}
+
+static void grow(struct service_table *table)
+{
+	unsigned int capacity = table->capacity * 2;
+
+	if (capacity < SERVICE_TABLE_MIN_CAPACITY)
+		capacity = SERVICE_TABLE_MIN_CAPACITY;
+
+	table->path = realloc(table->path, capacity * sizeof(char *));
+	table->name = realloc(table->name, capacity * sizeof(char *));
+	table->type = realloc(table->type, capacity);
+	table->state = realloc(table->state, capacity);
+	table->security = realloc(table->security, capacity);
+	table->strength = realloc(table->strength, capacity);
+	table->flags = realloc(table->flags, capacity * sizeof(uint16_t));
+	table->extra = realloc(table->extra, capacity *
+			sizeof(struct json_object *));
+
+	assert(table->path && table->name && table->type && table->state &&
+			table->security && table->strength && table->flags &&
+			table->extra);
+
+	table->capacity = capacity;
+}
+
+static void index_insert(struct service_table *table, unsigned int row)
+{
+	unsigned int mask = table->index_size - 1, i;
+
+	i = __atom_hash(table->path[row]) & mask;
+
+	while (table->index[i])
+		i = (i + 1) & mask;
+
+	table->index[i] = row + 1;
+}
+
+/*
+ * The index is kept at most half full. It is rebuilt when it grows.
+ */
+static void index_rebuild(struct service_table *table)
+{
+	unsigned int size = table->index_size ? table->index_size : 64, i;
+
+	while (size < table->capacity * 2)
+		size *= 2;
+
+	if (size != table->index_size) {
+		free(table->index);
+		table->index = malloc(size * sizeof(unsigned int));
+		assert(table->index != NULL);
+		table->index_size = size;
+	}
+
+	memset(table->index, 0, size * sizeof(unsigned int));
+
+	for (i = 0; i < table->count; i++)
+		index_insert(table, i);
+}
+
+// the slot of row in the index
+static unsigned int index_slot(struct service_table *table, unsigned int row)
+{
+	unsigned int mask = table->index_size - 1, i;
+
+	i = __atom_hash(table->path[row]) & mask;
+
+	while (table->index[i] != row + 1)
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+/*
+ * The rows after the slot of row that hashed before it move back, so
+ * that the probing still finds them.
+ */
+static void index_delete(struct service_table *table, unsigned int row)
+{
+	unsigned int mask = table->index_size - 1, i, j, k;
+
+	i = index_slot(table, row);
+
+	for (j = (i + 1) & mask; table->index[j]; j = (j + 1) & mask) {
+		k = __atom_hash(table->path[table->index[j] - 1]) & mask;
+
+		// k in (i, j]: found before reaching i
+		if (i <= j ? i < k && k <= j : i < k || k <= j)
+			continue;
+
+		table->index[i] = table->index[j];
+		i = j;
+	}
+
+	table->index[i] = 0;
+}
+
+/*
+ * Paths are atoms: a path never interned can't be in the table, and the
+ * others are compared by pointer.
+ */
+int __service_table_lookup(struct service_table *table, const char *path)
+{
+	unsigned int mask, i, row;
+
+	if (!table || !table->index_size || !(path = __atom_lookup(path)))
+		return -1;
+
+	mask = table->index_size - 1;
+	i = __atom_hash(path) & mask;
+
+	while ((row = table->index[i])) {
+		if (table->path[row - 1] == path)
+			return row - 1;
+
+		i = (i + 1) & mask;
+	}
+
+	return -1;
+}
+
+int __service_table_upsert(struct service_table *table, const char *path)
+{
+	int row = __service_table_lookup(table, path);
+
+	if (row >= 0)
+		return row;
+
+	if (table->count == table->capacity) {
+		grow(table);
+		index_rebuild(table);
+	}
+
+	row = table->count++;
+	table->path[row] = __atom_ref(path);
+	table->name[row] = NULL;
+	table->type[row] = SERVICE_TYPE_UNKNOWN;
+	table->state[row] = SERVICE_STATE_UNKNOWN;
+	table->security[row] = 0;
+	table->strength[row] = 0;
+	table->flags[row] = 0;
+	table->extra[row] = NULL;
+	index_insert(table, row);
+
+	return row;
+}
+
+#define ROW_MOVE(array, from, to) ((array)[to] = (array)[from])
+
+/*
+ * The last row takes the place of the removed one: only its index entry
+ * changes.
+ */
+void __service_table_remove(struct service_table *table, const char *path)
+{
+	int row = __service_table_lookup(table, path);
+	unsigned int last;
+
+	if (row < 0)
+		return;
+
+	last = table->count - 1;
+	index_delete(table, row);
+
+	if ((unsigned int) row != last)
+		table->index[index_slot(table, last)] = row + 1;
+
+	row_release(table, row);
+
+	ROW_MOVE(table->path, last, row);
+	ROW_MOVE(table->name, last, row);
+	ROW_MOVE(table->type, last, row);
+	ROW_MOVE(table->state, last, row);
+	ROW_MOVE(table->security, last, row);
+	ROW_MOVE(table->strength, last, row);
+	ROW_MOVE(table->flags, last, row);
+	ROW_MOVE(table->extra, last, row);
+
+	table->count--;
+}
+
+static void extra_set(struct service_table *table, int row, const char *key,
+		struct json_object *val)
+{
+	if (!table->extra[row])
+		table->extra[row] = json_object_new_object();
+
+	json_object_object_add(table->extra[row], key, json_object_get(val));
+}
+
+static void extra_del(struct service_table *table, int row, const char *key)
+{
+	if (table->extra[row] && json_object_object_get_ex(table->extra[row],
+				key, NULL))
+		json_object_object_del(table->extra[row], key);
+}
+
+static void set_flag(struct service_table *table, int row, uint16_t has,
+		uint16_t flag, bool val)
+{
+	table->flags[row] |= has;
+
+	if (val)
+		table->flags[row] |= flag;
+	else
+		table->flags[row] &= ~flag;
+}
+
+/*
+ * The hot properties, from values that aren't json (a PropertyChanged the
+ * engine reads from the message). They return false if key isn't a hot
+ * property of that type or the value can't be represented: the caller
+ * puts it in extra then, and a Type or State stops being hot.
+ */
+bool __service_table_set_string(struct service_table *table, int row,
+		const char *key, const char *str)
+{
+	const char *name;
+	int tmp;
+
+	assert(row >= 0 && (unsigned int) row < table->count);
+
+	if (strcmp(key, "Name") == 0) {
+		name = __atom_ref(str);
+		__atom_unref(table->name[row]);
+		table->name[row] = name;
+		table->flags[row] |= SERVICE_HAS_NAME;
+
+	} else if (strcmp(key, "Type") == 0) {
+		// an unknown one goes to extra, it is the only Type
+		if (!(tmp = __service_type_from_str(str))) {
+			table->type[row] = SERVICE_TYPE_UNKNOWN;
+			table->flags[row] &= ~SERVICE_HAS_TYPE;
+			return false;
+		}
+
+		table->type[row] = tmp;
+		table->flags[row] |= SERVICE_HAS_TYPE;
+
+	} else if (strcmp(key, "State") == 0) {
+		if (!(tmp = __service_state_from_str(str))) {
+			table->state[row] = SERVICE_STATE_UNKNOWN;
+			table->flags[row] &= ~SERVICE_HAS_STATE;
+			return false;
+		}
+
+		table->state[row] = tmp;
+		table->flags[row] |= SERVICE_HAS_STATE;
+
+	} else
+		return false;
+
+	extra_del(table, row, key);
+
+	return true;
+}
+
+bool __service_table_set_uint(struct service_table *table, int row,
+		const char *key, unsigned int val)
+{
+	assert(row >= 0 && (unsigned int) row < table->count);
+
+	if (strcmp(key, "Strength") != 0)
+		return false;
+
+	table->strength[row] = (uint8_t) val;
+	table->flags[row] |= SERVICE_HAS_STRENGTH;
+	extra_del(table, row, key);
+
+	return true;
+}
+
+bool __service_table_set_bool(struct service_table *table, int row,
+		const char *key, bool val)
+{
+	assert(row >= 0 && (unsigned int) row < table->count);
+
+	if (strcmp(key, "Favorite") == 0)
+		set_flag(table, row, SERVICE_HAS_FAVORITE, SERVICE_FAVORITE,
+				val);
+	else if (strcmp(key, "AutoConnect") == 0)
+		set_flag(table, row, SERVICE_HAS_AUTOCONNECT,
+				SERVICE_AUTOCONNECT, val);
+	else
+		return false;
+
+	extra_del(table, row, key);
+
+	return true;
+}
+
+static bool set_security(struct service_table *table, int row,
+		const char *key, int security)
+{
+	table->security[row] = security;
+	table->flags[row] |= SERVICE_HAS_SECURITY;
+	extra_del(table, row, key);
+
+	return true;
+}
+
+/*
+ * The hot property key from the value of a D-Bus message, read in place:
+ * the value is only copied if the table keeps it (the Name). false if key
+ * isn't hot or the value can't be represented.
+ */
+bool __service_table_set_dbus(struct service_table *table, int row,
+		const char *key, DBusMessageIter *value)
+{
+	unsigned char byte;
+	const char *str;
+	dbus_bool_t b;
+	int tmp;
+
+	switch (dbus_message_iter_get_arg_type(value)) {
+	case DBUS_TYPE_STRING:
+		dbus_message_iter_get_basic(value, &str);
+		return __service_table_set_string(table, row, key, str);
+
+	case DBUS_TYPE_BYTE:
+		dbus_message_iter_get_basic(value, &byte);
+		return __service_table_set_uint(table, row, key, byte);
+
+	case DBUS_TYPE_BOOLEAN:
+		dbus_message_iter_get_basic(value, &b);
+		return __service_table_set_bool(table, row, key, b);
+
+	case DBUS_TYPE_ARRAY:
+		return strcmp(key, "Security") == 0 &&
+			(tmp = security_from_iter(value)) >= 0 &&
+			set_security(table, row, key, tmp);
+
+	default:
+		return false;
+	}
+}
+
+/*
+ * Hot properties are stored typed, the others (or a value we can't
+ * represent, like an unknown Type) go to the extra dict of the row.
+ */
+void __service_table_set_property(struct service_table *table, int row,
+		const char *key, struct json_object *val)
+{
+	bool hot;
+	int tmp;
+
+	assert(row >= 0 && (unsigned int) row < table->count);
+
+	switch (json_object_get_type(val)) {
+	case json_type_string:
+		hot = __service_table_set_string(table, row, key,
+				json_object_get_string(val));
+		break;
+
+	case json_type_int:
+		hot = __service_table_set_uint(table, row, key,
+				json_object_get_int(val));
+		break;
+
+	case json_type_boolean:
+		hot = __service_table_set_bool(table, row, key,
+				json_object_get_boolean(val));
+		break;
+
+	case json_type_array:
+		hot = strcmp(key, "Security") == 0 &&
+			(tmp = security_from_json(val)) >= 0 &&
+			set_security(table, row, key, tmp);
+		break;
+
+	default:
+		hot = false;
+		break;
+	}
+
+	if (!hot)
+		extra_set(table, row, key, val);
+}
+
+/*
+ * Replace all the properties of a service with the ones of dict.
+ */
+void __service_table_set_dict(struct service_table *table, int row,
+		struct json_object *dict)
+{
+	__atom_unref(table->name[row]);
+	table->name[row] = NULL;
+	json_object_put(table->extra[row]);
+	table->extra[row] = NULL;
+	table->flags[row] = 0;
+
+	json_object_object_foreach(dict, key, val)
+		__service_table_set_property(table, row, key, val);
+}
+
+/*
+ [
+	 [ "/net/connman/service/...", { dict } ],
+	 ...
+ ]
+ */
+void __service_table_load(struct service_table *table,
+		struct json_object *jservices)
+{
+	struct json_object *sub_array;
+	const char *path;
+	int len, i;
+
+	__service_table_clear(table);
+	len = json_object_array_length(jservices);
+
+	for (i = 0; i < len; i++) {
+		sub_array = json_object_array_get_idx(jservices, i);
+		path = json_object_get_string(json_object_array_get_idx(
+					sub_array, 0));
+
+		if (path)
+			__service_table_set_dict(table,
+					__service_table_upsert(table, path),
+					json_object_array_get_idx(sub_array, 1));
+	}
+}
+
+struct load_dbus {
+	struct service_table *table;
+	int row;
+};
+
+static void load_dbus_object(const char *path, void *user_data)
+{
+	struct load_dbus *load = user_data;
+
+	load->row = __service_table_upsert(load->table, path);
+}
+
+static void load_dbus_property(const char *key, DBusMessageIter *value,
+		void *user_data)
+{
+	struct load_dbus *load = user_data;
+	struct json_object *val;
+
+	if (__service_table_set_dbus(load->table, load->row, key, value))
+		return;
+
+	val = __connman_dbus_value_to_json(value);
+	extra_set(load->table, load->row, key, val);
+	json_object_put(val);
+}
+
+struct load_chunk {
+	struct dbus_objects_chunk *chunk;
+	struct service_table *table;
+	pthread_t thread;
+	bool started;
+};
+
+static void* load_chunk(void *data)
+{
+	struct load_chunk *load_chunk = data;
+	struct load_dbus load = { load_chunk->table, -1 };
+
+	__connman_dbus_json_own_strings(true);
+	__connman_dbus_objects_chunk_foreach(load_chunk->chunk,
+			load_dbus_object, load_dbus_property, &load);
+	__connman_dbus_json_own_strings(false);
+
+	return NULL;
+}
+
+// the rows of from go to the end of table, in their order
+static void move_rows(struct service_table *table,
+		struct service_table *from)
+{
+	unsigned int i;
+	int row;
+
+	for (i = 0; i < from->count; i++) {
+		row = __service_table_upsert(table, from->path[i]);
+		json_object_put(table->extra[row]);
+		__atom_unref(table->name[row]);
+
+		table->name[row] = from->name[i];
+		from->name[i] = NULL;
+		table->type[row] = from->type[i];
+		table->state[row] = from->state[i];
+		table->security[row] = from->security[i];
+		table->strength[row] = from->strength[i];
+		table->flags[row] = from->flags[i];
+		table->extra[row] = from->extra[i];
+		from->extra[i] = NULL;
+	}
+}
+
+/*
+ * __service_table_load from the a(oa{sv}) of GetServices, without
+ * decoding it to json first: the strings are borrowed from the message,
+ * only the paths, the names and the values of the extra dicts are copied.
+ *
+ * With workers > 1, a big reply is split between that many threads (the
+ * calling one included), each loading its part in a table of its own:
+ * the rows are then moved to table, in the order of the reply. A part
+ * whose thread can't be started is loaded by the calling thread.
+ */
+int __service_table_load_dbus(struct service_table *table,
+		DBusMessageIter *iter, unsigned int workers)
+{
+	struct dbus_objects_chunk chunks[SERVICE_TABLE_MAX_WORKERS];
+	struct load_chunk loads[SERVICE_TABLE_MAX_WORKERS];
+	struct load_dbus load = { table, -1 };
+	int nb_chunks, i;
+
+	__service_table_clear(table);
+
+	if (workers > SERVICE_TABLE_MAX_WORKERS)
+		workers = SERVICE_TABLE_MAX_WORKERS;
+
+	if (workers < 2)
+		return __connman_dbus_objects_foreach(iter, load_dbus_object,
+				load_dbus_property, &load);
+
+	nb_chunks = __connman_dbus_objects_split(iter, chunks, workers,
+			SERVICE_TABLE_MIN_CHUNK);
+
+	if (nb_chunks < 0)
+		return nb_chunks;
+
+	// the first part goes straight to table, by the calling thread
+	for (i = 1; i < nb_chunks; i++) {
+		loads[i].chunk = &chunks[i];
+		loads[i].table = __service_table_new();
+		loads[i].started = pthread_create(&loads[i].thread, NULL,
+				load_chunk, &loads[i]) == 0;
+	}
+
+	if (nb_chunks > 0) {
+		loads[0].chunk = &chunks[0];
+		loads[0].table = table;
+		load_chunk(&loads[0]);
+	}
+
+	for (i = 1; i < nb_chunks; i++) {
+		if (loads[i].started)
+			pthread_join(loads[i].thread, NULL);
+		else
+			load_chunk(&loads[i]);
+
+		move_rows(table, loads[i].table);
+		__service_table_free(loads[i].table);
+	}
+
+	return 0;
+}
+
+static bool extra_equal(struct json_object *a, struct json_object *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return strcmp(json_object_to_json_string(a),
+			json_object_to_json_string(b)) == 0;
+}
+
+/*
+ * Like __service_table_set_dict, but returns whether the service changed.
+ * A typed value only counts if its flag is set.
+ */
+static bool set_dict_diff(struct service_table *table, int row,
+		struct json_object *dict)
+{
+	const char *name = __atom_dup(table->name[row]);
+	uint8_t type = table->type[row], state = table->state[row],
+		security = table->security[row],
+		strength = table->strength[row];
+	uint16_t flags = table->flags[row];
+	struct json_object *extra = json_object_get(table->extra[row]);
+	bool res;
+
+	__service_table_set_dict(table, row, dict);
+
+	res = flags != table->flags[row] ||
+		((flags & SERVICE_HAS_NAME) && name != table->name[row]) ||
+		((flags & SERVICE_HAS_TYPE) && type != table->type[row]) ||
+		((flags & SERVICE_HAS_STATE) &&
+		 state != table->state[row]) ||
+		((flags & SERVICE_HAS_SECURITY) &&
+		 security != table->security[row]) ||
+		((flags & SERVICE_HAS_STRENGTH) &&
+		 strength != table->strength[row]) ||
+		!extra_equal(extra, table->extra[row]);
+
+	__atom_unref(name);
+	json_object_put(extra);
+
+	return res;
+}
+
+#define ROW_PERMUTE(array, order, n, type) do { \
+	type *tmp = malloc(((n) + 1) * sizeof(type)); \
+	unsigned int k; \
+	assert(tmp != NULL); \
+	for (k = 0; k < (n); k++) \
+		tmp[k] = (array)[(order)[k]]; \
+	memcpy((array), tmp, (n) * sizeof(type)); \
+	free(tmp); \
+} while (0)
+
+/*
+ * Bring the table to the content of jservices (same format as for
+ * __service_table_load) without rebuilding it: the rows that didn't change
+ * are left alone. Returns the number of services added, modified, removed
+ * or moved.
+ */
+int __service_table_reconcile(struct service_table *table,
+		struct json_object *jservices)
+{
+	struct json_object *sub_array;
+	unsigned int *order, nb_order = 0, i;
+	const char *path;
+	bool *seen;
+	int len, row, changes = 0;
+
+	len = json_object_array_length(jservices);
+	order = malloc((table->count + len + 1) * sizeof(unsigned int));
+	seen = calloc(table->count + len + 1, sizeof(bool));
+	assert(order != NULL && seen != NULL);
+
+	for (i = 0; i < (unsigned int) len; i++) {
+		sub_array = json_object_array_get_idx(jservices, i);
+		path = json_object_get_string(json_object_array_get_idx(
+					sub_array, 0));
+
+		if (!path)
+			continue;
+
+		if ((row = __service_table_lookup(table, path)) < 0) {
+			row = __service_table_upsert(table, path);
+			changes++;
+		}
+
+		if (seen[row])
+			continue;
+
+		if (set_dict_diff(table, row, json_object_array_get_idx(
+						sub_array, 1)))
+			changes++;
+
+		seen[row] = true;
+		order[nb_order++] = row;
+	}
+
+	// the services that are gone
+	for (i = 0; i < table->count; i++) {
+		if (!seen[i]) {
+			row_release(table, i);
+			changes++;
+		}
+	}
+
+	for (i = 0; i < nb_order; i++)
+		if (order[i] != i)
+			break;
+
+	if (i < nb_order || nb_order != table->count) {
+		if (i < nb_order)
+			changes++;
+
+		// ConnMan's order, without the services that are gone
+		ROW_PERMUTE(table->path, order, nb_order, const char *);
+		ROW_PERMUTE(table->name, order, nb_order, const char *);
+		ROW_PERMUTE(table->type, order, nb_order, uint8_t);
+		ROW_PERMUTE(table->state, order, nb_order, uint8_t);
+		ROW_PERMUTE(table->security, order, nb_order, uint8_t);
+		ROW_PERMUTE(table->strength, order, nb_order, uint8_t);
+		ROW_PERMUTE(table->flags, order, nb_order, uint16_t);
+		ROW_PERMUTE(table->extra, order, nb_order,
+				struct json_object *);
+
+		table->count = nb_order;
+		index_rebuild(table);
+	}
+
+	free(order);
+	free(seen);
+
+	return changes;
+}
+
+/*
+ * The json dict of a service is only built here, when it leaves the
+ * engine. The extra values are shared with the table.
+ */
+struct json_object* __service_table_dict_json(struct service_table *table,
+		int row)
+{
+	struct json_object *res = json_object_new_object();
+	uint16_t flags = table->flags[row];
+
+	if (flags & SERVICE_HAS_NAME)
+		json_object_object_add(res, "Name",
+				__atom_json(table->name[row]));
+
+	if (flags & SERVICE_HAS_TYPE)
+		json_object_object_add(res, "Type", json_object_new_string(
+					__service_type_str(table->type[row])));
+
+	if (flags & SERVICE_HAS_SECURITY)
+		json_object_object_add(res, "Security",
+				security_to_json(table->security[row]));
+
+	if (flags & SERVICE_HAS_STATE)
+		json_object_object_add(res, "State", json_object_new_string(
+					__service_state_str(table->state[row])));
+
+	if (flags & SERVICE_HAS_STRENGTH)
+		json_object_object_add(res, "Strength",
+				json_object_new_int(table->strength[row]));
+
+	if (flags & SERVICE_HAS_FAVORITE)
+		json_object_object_add(res, "Favorite", json_object_new_boolean(
+					!!(flags & SERVICE_FAVORITE)));
+
+	if (flags & SERVICE_HAS_AUTOCONNECT)
+		json_object_object_add(res, "AutoConnect",
+				json_object_new_boolean(
+					!!(flags & SERVICE_AUTOCONNECT)));
+
+	if (table->extra[row]) {
+		json_object_object_foreach(table->extra[row], key, val)
+			json_object_object_add(res, key, json_object_get(val));
+	}
+
+	return res;
+}
+
+/*
+ * [ "/net/connman/service/...", { dict } ]
+ */
+struct json_object* __service_table_to_json(struct service_table *table,
+		int row)
+{
+	struct json_object *res = json_object_new_array();
+
+	json_object_array_add(res, __atom_json(table->path[row]));
+	json_object_array_add(res, __service_table_dict_json(table, row));
+
+	return res;
+}
@@ -0,0 +1,166 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_SERVICE_TABLE_H
+#define __CONNMAN_SERVICE_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <json/json.h>
+#include <dbus/dbus.h>
+
+/* threads of __service_table_load_dbus, the calling one included */
+#define SERVICE_TABLE_MAX_WORKERS 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum service_type {
+	SERVICE_TYPE_UNKNOWN = 0,
+	SERVICE_TYPE_SYSTEM,
+	SERVICE_TYPE_ETHERNET,
+	SERVICE_TYPE_WIFI,
+	SERVICE_TYPE_BLUETOOTH,
+	SERVICE_TYPE_CELLULAR,
+	SERVICE_TYPE_GPS,
+	SERVICE_TYPE_VPN,
+	SERVICE_TYPE_GADGET,
+	SERVICE_TYPE_P2P,
+};
+
+enum service_state {
+	SERVICE_STATE_UNKNOWN = 0,
+	SERVICE_STATE_IDLE,
+	SERVICE_STATE_FAILURE,
+	SERVICE_STATE_ASSOCIATION,
+	SERVICE_STATE_CONFIGURATION,
+	SERVICE_STATE_READY,
+	SERVICE_STATE_DISCONNECT,
+	SERVICE_STATE_ONLINE,
+};
+
+/* "Security" is an array in ConnMan, so it is stored as a set of flags */
+enum service_security {
+	SERVICE_SECURITY_NONE		= 1 << 0,
+	SERVICE_SECURITY_WEP		= 1 << 1,
+	SERVICE_SECURITY_PSK		= 1 << 2,
+	SERVICE_SECURITY_IEEE8021X	= 1 << 3,
+	SERVICE_SECURITY_WPS		= 1 << 4,
+	SERVICE_SECURITY_WPS_ADVERTISING	= 1 << 5,
+};
+
+/* which hot properties a service has, and the value of the booleans */
+enum service_flags {
+	SERVICE_HAS_NAME	= 1 << 0,
+	SERVICE_HAS_TYPE	= 1 << 1,
+	SERVICE_HAS_STATE	= 1 << 2,
+	SERVICE_HAS_SECURITY	= 1 << 3,
+	SERVICE_HAS_STRENGTH	= 1 << 4,
+	SERVICE_HAS_FAVORITE	= 1 << 5,
+	SERVICE_HAS_AUTOCONNECT	= 1 << 6,
+	SERVICE_FAVORITE	= 1 << 7,
+	SERVICE_AUTOCONNECT	= 1 << 8,
+};
+
+/*
+ * The services as a struct of arrays: row i of every array describes the
+ * same service, rows are kept in ConnMan's order.
+ * The properties that aren't "hot" (IPv4, Proxy, Ethernet...) stay in the
+ * extra json dict of the row, NULL if the service has none.
+ */
+struct service_table {
+	unsigned int count;
+	unsigned int capacity;
+
+	/* atoms, see atoms.h */
+	const char **path;
+	const char **name;
+	uint8_t *type;
+	uint8_t *state;
+	uint8_t *security;
+	uint8_t *strength;
+	uint16_t *flags;
+	struct json_object **extra;
+
+	/* path -> row + 1, open addressing (0 is an empty slot) */
+	unsigned int *index;
+	unsigned int index_size;
+};
+
+enum service_type __service_type_from_str(const char *str);
+
+const char* __service_type_str(enum service_type type);
+
+enum service_state __service_state_from_str(const char *str);
+
+const char* __service_state_str(enum service_state state);
+
+bool __service_state_is_connected(enum service_state state);
+
+struct service_table* __service_table_new(void);
+
+void __service_table_free(struct service_table *table);
+
+void __service_table_clear(struct service_table *table);
+
+int __service_table_lookup(struct service_table *table, const char *path);
+
+int __service_table_upsert(struct service_table *table, const char *path);
+
+void __service_table_remove(struct service_table *table, const char *path);
+
+void __service_table_set_property(struct service_table *table, int row,
+		const char *key, struct json_object *val);
+
+bool __service_table_set_string(struct service_table *table, int row,
+		const char *key, const char *str);
+
+bool __service_table_set_uint(struct service_table *table, int row,
+		const char *key, unsigned int val);
+
+bool __service_table_set_bool(struct service_table *table, int row,
+		const char *key, bool val);
+
+bool __service_table_set_dbus(struct service_table *table, int row,
+		const char *key, DBusMessageIter *value);
+
+void __service_table_set_dict(struct service_table *table, int row,
+		struct json_object *dict);
+
+void __service_table_load(struct service_table *table,
+		struct json_object *jservices);
+
+int __service_table_load_dbus(struct service_table *table,
+		DBusMessageIter *iter, unsigned int workers);
+
+int __service_table_reconcile(struct service_table *table,
+		struct json_object *jservices);
+
+struct json_object* __service_table_dict_json(struct service_table *table,
+		int row);
+
+struct json_object* __service_table_to_json(struct service_table *table,
+		int row);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
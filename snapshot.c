@@ -0,0 +1,483 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <json/json.h>
+
+#include "atoms.h"
+#include "service_table.h"
+#include "snapshot.h"
+
+struct snapshot_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t time;
+	uint32_t length;	// of the payload
+	uint32_t crc;		// of the payload
+};
+
+struct buffer {
+	unsigned char *data;
+	size_t len;
+	size_t size;
+};
+
+struct cursor {
+	const unsigned char *pos;
+	const unsigned char *end;
+};
+
+static uint32_t crc_table[256];
+
+static void crc_init(void)
+{
+	uint32_t c;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+
+		for (j = 0; j < 8; j++)
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+
+		crc_table[i] = c;
+	}
+}
+
+static uint32_t compute_crc(const unsigned char *data, size_t len)
+{
+	uint32_t crc = 0xffffffffu;
+
+	if (!crc_table[1])
+		crc_init();
+
+	while (len--)
+		crc = crc_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffffu;
+}
+
+/*
+ * $XDG_CACHE_HOME/connman-json-client/snapshot, or ~/.cache/... if it isn't
+ * set. NULL if neither is available.
+ */
+const char* __snapshot_default_path(void)
+{
+	static char path[PATH_MAX];
+	const char *base = getenv("XDG_CACHE_HOME"), *home;
+	int len;
+
+	if (base && base[0] == '/')
+		len = snprintf(path, sizeof(path), "%s/connman-json-client",
+				base);
+	else if ((home = getenv("HOME")) && home[0] == '/')
+		len = snprintf(path, sizeof(path),
+				"%s/.cache/connman-json-client", home);
+	else
+		return NULL;
+
+	if (len < 0 || (size_t) len + sizeof("/snapshot") > sizeof(path))
+		return NULL;
+
+	strcat(path, "/snapshot");
+
+	return path;
+}
+
+static void put(struct buffer *buf, const void *data, size_t len)
+{
+	if (buf->len + len > buf->size) {
+		while (buf->len + len > buf->size)
+			buf->size = buf->size ? buf->size * 2 : 4096;
+
+		buf->data = realloc(buf->data, buf->size);
+		assert(buf->data != NULL);
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void put_u8(struct buffer *buf, uint8_t val)
+{
+	put(buf, &val, sizeof(val));
+}
+
+static void put_u16(struct buffer *buf, uint16_t val)
+{
+	put(buf, &val, sizeof(val));
+}
+
+static void put_u32(struct buffer *buf, uint32_t val)
+{
+	put(buf, &val, sizeof(val));
+}
+
+// strings are stored with their '\0', a length of 0 is NULL
+static void put_str(struct buffer *buf, const char *str)
+{
+	uint32_t len = str ? strlen(str) + 1 : 0;
+
+	put_u32(buf, len);
+	put(buf, str, len);
+}
+
+static void put_json(struct buffer *buf, struct json_object *jobj)
+{
+	put_str(buf, jobj ? json_object_to_json_string(jobj) : NULL);
+}
+
+static int write_all(int fd, const void *data, size_t len)
+{
+	const char *pos = data;
+	ssize_t res;
+
+	while (len) {
+		res = write(fd, pos, len);
+
+		if (res < 0 && errno == EINTR)
+			continue;
+
+		if (res < 0)
+			return -errno;
+
+		pos += res;
+		len -= res;
+	}
+
+	return 0;
+}
+
+static void mkdir_parent(const char *file)
+{
+	char dir[PATH_MAX], *slash;
+
+	snprintf(dir, sizeof(dir), "%s", file);
+
+	for (slash = strchr(dir + 1, '/'); slash;
+			slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		mkdir(dir, 0700);
+		*slash = '/';
+	}
+}
+
+/*
+ * The snapshot is written next to the old one and renamed over it, a
+ * crash while saving leaves the previous snapshot intact.
+ */
+int __snapshot_save(const char *file, struct json_object *state,
+		struct json_object *technologies,
+		struct service_table *services)
+{
+	struct snapshot_header header;
+	struct buffer buf = { NULL, 0, 0 };
+	char tmp_file[PATH_MAX];
+	unsigned int i;
+	int fd, res;
+
+	if (!file || !state || !technologies || !services)
+		return -EINVAL;
+
+	put_json(&buf, state);
+	put_json(&buf, technologies);
+	put_u32(&buf, services->count);
+
+	for (i = 0; i < services->count; i++) {
+		put_str(&buf, services->path[i]);
+		put_str(&buf, services->name[i]);
+		put_u8(&buf, services->type[i]);
+		put_u8(&buf, services->state[i]);
+		put_u8(&buf, services->security[i]);
+		put_u8(&buf, services->strength[i]);
+		put_u16(&buf, services->flags[i]);
+		put_json(&buf, services->extra[i]);
+	}
+
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.time = time(NULL);
+	header.length = buf.len;
+	header.crc = compute_crc(buf.data, buf.len);
+
+	mkdir_parent(file);
+	snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", file);
+	fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+	if (fd < 0) {
+		free(buf.data);
+		return -errno;
+	}
+
+	res = write_all(fd, &header, sizeof(header));
+
+	if (!res)
+		res = write_all(fd, buf.data, buf.len);
+
+	if (!res && fsync(fd) < 0)
+		res = -errno;
+
+	close(fd);
+	free(buf.data);
+
+	if (!res && rename(tmp_file, file) < 0)
+		res = -errno;
+
+	if (res)
+		unlink(tmp_file);
+
+	return res;
+}
+
+static const void* get(struct cursor *cur, size_t len)
+{
+	const void *res = cur->pos;
+
+	if ((size_t) (cur->end - cur->pos) < len)
+		return NULL;
+
+	cur->pos += len;
+
+	return res;
+}
+
+static int get_u8(struct cursor *cur, uint8_t *val)
+{
+	const uint8_t *res = get(cur, sizeof(*val));
+
+	if (!res)
+		return -EINVAL;
+
+	*val = *res;
+
+	return 0;
+}
+
+static int get_u16(struct cursor *cur, uint16_t *val)
+{
+	const void *res = get(cur, sizeof(*val));
+
+	if (!res)
+		return -EINVAL;
+
+	memcpy(val, res, sizeof(*val));
+
+	return 0;
+}
+
+static int get_u32(struct cursor *cur, uint32_t *val)
+{
+	const void *res = get(cur, sizeof(*val));
+
+	if (!res)
+		return -EINVAL;
+
+	memcpy(val, res, sizeof(*val));
+
+	return 0;
+}
+
+/*
+ * Points into the mapping, valid until it is unmapped.
+ */
+static int get_str(struct cursor *cur, const char **str)
+{
+	uint32_t len;
+
+	if (get_u32(cur, &len) < 0)
+		return -EINVAL;
+
+	if (len == 0) {
+		*str = NULL;
+		return 0;
+	}
+
+	if (!(*str = get(cur, len)) || (*str)[len - 1] != '\0')
+		return -EINVAL;
+
+	return 0;
+}
+
+static int get_json(struct cursor *cur, struct json_object **jobj)
+{
+	const char *str;
+
+	if (get_str(cur, &str) < 0)
+		return -EINVAL;
+
+	if (!str) {
+		*jobj = NULL;
+		return 0;
+	}
+
+	*jobj = json_tokener_parse(str);
+
+	return *jobj ? 0 : -EINVAL;
+}
+
+static int load_services(struct cursor *cur, struct service_table *services)
+{
+	struct json_object *extra;
+	const char *path, *name;
+	uint8_t type, state, security, strength;
+	uint16_t flags;
+	uint32_t count, i;
+	int row;
+
+	if (get_u32(cur, &count) < 0)
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		if (get_str(cur, &path) < 0 || !path ||
+				get_str(cur, &name) < 0 ||
+				get_u8(cur, &type) < 0 ||
+				get_u8(cur, &state) < 0 ||
+				get_u8(cur, &security) < 0 ||
+				get_u8(cur, &strength) < 0 ||
+				get_u16(cur, &flags) < 0 ||
+				get_json(cur, &extra) < 0)
+			return -EINVAL;
+
+		if (type > SERVICE_TYPE_P2P || state > SERVICE_STATE_ONLINE ||
+				flags >= SERVICE_AUTOCONNECT << 1 ||
+				(extra && !json_object_is_type(extra,
+							json_type_object))) {
+			json_object_put(extra);
+			return -EINVAL;
+		}
+
+		row = __service_table_upsert(services, path);
+		__atom_unref(services->name[row]);
+		services->name[row] = __atom_ref(name);
+		services->type[row] = type;
+		services->state[row] = state;
+		services->security[row] = security;
+		services->strength[row] = strength;
+		services->flags[row] = flags;
+		json_object_put(services->extra[row]);
+		services->extra[row] = extra;
+	}
+
+	return 0;
+}
+
+static int load(const unsigned char *data, size_t size,
+		struct json_object **state, struct json_object **technologies,
+		struct service_table *services)
+{
+	struct snapshot_header header;
+	struct cursor cur;
+	time_t now = time(NULL);
+
+	if (size < sizeof(header))
+		return -EINVAL;
+
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != SNAPSHOT_MAGIC ||
+			header.version != SNAPSHOT_VERSION ||
+			header.length != size - sizeof(header))
+		return -EINVAL;
+
+	if ((uint64_t) now < header.time ||
+			(uint64_t) now - header.time > SNAPSHOT_MAX_AGE)
+		return -ESTALE;
+
+	cur.pos = data + sizeof(header);
+	cur.end = cur.pos + header.length;
+
+	if (compute_crc(cur.pos, header.length) != header.crc)
+		return -EINVAL;
+
+	if (get_json(&cur, state) < 0 || !*state)
+		return -EINVAL;
+
+	if (get_json(&cur, technologies) < 0 || !*technologies ||
+			!json_object_is_type(*technologies, json_type_array))
+		return -EINVAL;
+
+	if (load_services(&cur, services) < 0 || cur.pos != cur.end)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * On success state and technologies are new objects and services is
+ * filled. A snapshot that can't be used (another version, too old,
+ * corrupted...) is removed and nothing is returned.
+ */
+int __snapshot_load(const char *file, struct json_object **state,
+		struct json_object **technologies,
+		struct service_table *services)
+{
+	struct stat st;
+	void *data;
+	int fd, res;
+
+	*state = NULL;
+	*technologies = NULL;
+
+	if (!file)
+		return -EINVAL;
+
+	if ((fd = open(file, O_RDONLY)) < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		unlink(file);
+		return -EINVAL;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return -errno;
+
+	res = load(data, st.st_size, state, technologies, services);
+	munmap(data, st.st_size);
+
+	if (res < 0) {
+		json_object_put(*state);
+		json_object_put(*technologies);
+		*state = NULL;
+		*technologies = NULL;
+		__service_table_clear(services);
+		unlink(file);
+	}
+
+	return res;
+}
@@ -0,0 +1,58 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_SNAPSHOT_H
+#define __CONNMAN_SNAPSHOT_H
+
+#include <json/json.h>
+
+#include "service_table.h"
+
+/* "CJSN" */
+#define SNAPSHOT_MAGIC 0x4e534a43
+/* bump it each time the layout of the file changes */
+#define SNAPSHOT_VERSION 1
+/* older snapshots are dropped, the network has probably changed too much */
+#define SNAPSHOT_MAX_AGE (7 * 24 * 3600)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The engine cache on disk: a header (magic, version, time, payload length
+ * and crc32) followed by the payload. state and technologies are stored as
+ * json text, services as the typed rows of the service table.
+ */
+
+const char* __snapshot_default_path(void);
+
+int __snapshot_save(const char *file, struct json_object *state,
+		struct json_object *technologies,
+		struct service_table *services);
+
+int __snapshot_load(const char *file, struct json_object **state,
+		struct json_object **technologies,
+		struct service_table *services);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "spsc_ring.h"
+
+#define CACHE_LINE 64
+
+/*
+ * head and tail only grow (modulo 2^32), the slot is the index & mask.
+ * They are on their own cache line: the two threads don't bounce a line
+ * each time the other side moves.
+ */
+struct spsc_ring {
+	unsigned int mask;
+	size_t elem_size;
+	unsigned char *elems;
+
+	char pad1[CACHE_LINE];
+	unsigned int head;	// next to pop, written by the consumer
+
+	char pad2[CACHE_LINE];
+	unsigned int tail;	// next to push, written by the producer
+
+	char pad3[CACHE_LINE];
+};
+
+/*
+ * size is rounded up to a power of 2.
+ */
+struct spsc_ring* __spsc_ring_new(unsigned int size, size_t elem_size)
+{
+	struct spsc_ring *ring;
+	unsigned int real_size = 1;
+
+	while (real_size < size)
+		real_size *= 2;
+
+	ring = calloc(1, sizeof(struct spsc_ring));
+	assert(ring != NULL);
+	ring->mask = real_size - 1;
+	ring->elem_size = elem_size;
+	ring->elems = malloc(real_size * elem_size);
+	assert(ring->elems != NULL);
+
+	return ring;
+}
+
+void __spsc_ring_free(struct spsc_ring *ring)
+{
+	if (!ring)
+		return;
+
+	free(ring->elems);
+	free(ring);
+}
+
+bool __spsc_ring_push(struct spsc_ring *ring, const void *elem)
+{
+	unsigned int tail = ring->tail;
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if (tail - head > ring->mask)
+		return false;
+
+	memcpy(ring->elems + (tail & ring->mask) * ring->elem_size, elem,
+			ring->elem_size);
+
+	// the element is written before the consumer can see it
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+bool __spsc_ring_pop(struct spsc_ring *ring, void *elem)
+{
+	unsigned int head = ring->head;
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return false;
+
+	memcpy(elem, ring->elems + (head & ring->mask) * ring->elem_size,
+			ring->elem_size);
+
+	// the slot is read before the producer can reuse it
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
@@ -0,0 +1,51 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_SPSC_RING_H
+#define __CONNMAN_SPSC_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A bounded queue between exactly one producer thread and one consumer
+ * thread, without lock: each side only writes its own index. Elements are
+ * copied in and out.
+ */
+struct spsc_ring;
+
+struct spsc_ring* __spsc_ring_new(unsigned int size, size_t elem_size);
+
+void __spsc_ring_free(struct spsc_ring *ring);
+
+/* false if the ring is full */
+bool __spsc_ring_push(struct spsc_ring *ring, const void *elem);
+
+/* false if the ring is empty */
+bool __spsc_ring_pop(struct spsc_ring *ring, void *elem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
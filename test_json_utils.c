@@ -46,6 +46,9 @@ int main()
 	}";
 	*/
 	struct json_object *jtmp, *jtrusted, *jsubtrusted, *jsubtrusted2, *jsubtrusted3;
+	struct json_object *jnamed, *jsubnamed, *jsubnamed2, *jsubnamed3;
+	struct regex_cache_stats stats;
+	bool results[16];
 	int i;
 
 	printf("\n[*] start\n");
@@ -69,7 +72,9 @@ int main()
 		jtmp = json_tokener_parse(to_test[i]);
 		printf("\n[*] test %d ... ", i);
 
-		if (__json_type_dispatch(jtmp, jtrusted))
+		results[i] = __json_type_dispatch(jtmp, jtrusted);
+
+		if (results[i])
 			printf("PASSED");
 		else
 			printf("FAILED");
@@ -80,7 +85,46 @@ int main()
 		jtmp = NULL;
 	}
 
+	// the two regexes are compiled once
+	__match_strings_stats(&stats);
+	printf("\n[*] regex cache: %lu hits, %lu misses ... %s\n", stats.hits,
+			stats.misses, stats.misses == 2 ? "PASSED" : "FAILED");
+
+	// the named validators agree with the regexes
+	jnamed = json_object_new_object();
+	jsubnamed = json_object_new_object();
+	jsubnamed2 = json_object_new_object();
+	jsubnamed3 = json_object_new_object();
+
+	json_object_object_add(jsubnamed2, "Address", json_object_new_string("@ipv4"));
+	json_object_object_add(jsubnamed, "IPv4", jsubnamed2);
+	json_object_object_add(jsubnamed3, "Address", json_object_new_string("@ipv6"));
+	json_object_object_add(jsubnamed, "IPv6", jsubnamed3);
+	json_object_object_add(jnamed, "options", jsubnamed);
+
+	for (i = 0; to_test[i]; i++) {
+		jtmp = json_tokener_parse(to_test[i]);
+		printf("\n[*] named test %d ... %s", i,
+				__json_type_dispatch(jtmp, jnamed) == results[i] ?
+				"PASSED" : "FAILED");
+		json_object_put(jtmp);
+	}
+
+	printf("\n[*] validators ... %s\n",
+			__validate_dbus_path("/net/connman/service/wifi_0011_psk") &&
+			__validate_dbus_path("/") &&
+			!__validate_dbus_path("/net//connman") &&
+			!__validate_dbus_path("/net/") &&
+			__validate_dbus_name("wifi_0011_psk") &&
+			!__validate_dbus_name("../wifi") &&
+			__validate_ipv6("::ffff:192.168.1.1") &&
+			!__validate_ipv6("1:2:3:4:5:6:7:8:9") &&
+			!__validate_ipv4("01.2.3.4") &&
+			__validate_prefix_length("128") &&
+			!__validate_prefix_length("129") ? "PASSED" : "FAILED");
+
 	printf("\n[*] the end.\n");
+	json_object_put(jnamed);
 	json_object_put(jtrusted);
 
 	return 0;
@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <json/json.h>
+
+#include "loop.h"
+#include "server.h"
+
+/*
+ * A client sending invalid lines without ever reading its replies: the
+ * server queues error replies until SERVER_MAX_PENDING and drops it, in
+ * the middle of its lines. Run it under ASan, the client must not be used
+ * once freed. The server must still answer the other clients.
+ */
+
+#define FLOOD_BYTES (8 << 20)
+
+void __connman_callback_ended(void)
+{
+}
+
+static bool quit(void *data)
+{
+	loop_quit();
+
+	return false;
+}
+
+// one loop iteration, at least
+static void run_loop(void)
+{
+	loop_add_timer(0, quit, NULL);
+	loop_run(false);
+}
+
+static int connect_client(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("[-] connect");
+		exit(1);
+	}
+
+	return fd;
+}
+
+// true once the server closed fd
+static bool closed(int fd)
+{
+	char buf[65536];
+	ssize_t len;
+
+	while ((len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+		;
+
+	return len == 0 || (len < 0 && errno != EAGAIN);
+}
+
+// the reply to a valid command, within a few loop iterations
+static bool answers(int fd)
+{
+	const char *line = "{ \"command\": \"get_server_stats\" }\n";
+	char buf[4096];
+	ssize_t len;
+	int i;
+
+	if (write(fd, line, strlen(line)) != (ssize_t) strlen(line))
+		return false;
+
+	for (i = 0; i < 100; i++) {
+		run_loop();
+		len = recv(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+
+		if (len > 0) {
+			buf[len] = '\0';
+			return strstr(buf, "\"status\": 0") != NULL;
+		}
+	}
+
+	return false;
+}
+
+int main()
+{
+	char path[64], lines[4096];
+	size_t sent = 0;
+	int flooder, other, i;
+	bool dropped = false, answered;
+	ssize_t len;
+
+	snprintf(path, sizeof(path), "/tmp/test_server-%d.sock", getpid());
+	loop_init();
+
+	if (__server_start(path) < 0) {
+		printf("[-] can't listen on %s\n", path);
+		return 1;
+	}
+
+	flooder = connect_client(path);
+	other = connect_client(path);
+	fcntl(flooder, F_SETFL, O_NONBLOCK);
+	run_loop();
+
+	for (i = 0; i + 2 <= (int) sizeof(lines); i += 2)
+		memcpy(lines + i, "x\n", 2);
+
+	while (sent < FLOOD_BYTES && !dropped) {
+		len = send(flooder, lines, sizeof(lines), MSG_NOSIGNAL);
+
+		if (len > 0)
+			sent += len;
+		else if (errno != EAGAIN)
+			dropped = true;
+
+		run_loop();
+	}
+
+	for (i = 0; i < 100 && !dropped; i++) {
+		run_loop();
+		dropped = closed(flooder);
+	}
+
+	printf("[*] flooding client dropped after %zu bytes: %s\n", sent,
+			dropped ? "yes" : "NO");
+	answered = answers(other);
+	printf("[*] other client answered: %s\n", answered ? "yes" : "NO");
+
+	close(flooder);
+	close(other);
+	__server_stop();
+	loop_destroy();
+
+	return dropped && answered ? 0 : 1;
+}
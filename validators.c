@@ -0,0 +1,277 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <json/json.h>
+
+#include "validators.h"
+
+/*
+ * The dbus names and paths are checked by DFAs: one table lookup per
+ * character, no backtracking. The addresses are parsed like inet_pton does.
+ */
+
+enum char_class {
+	CLASS_OTHER = 0,
+	CLASS_NAME,	// [A-Za-z0-9_]
+	CLASS_SLASH,
+	NB_CLASSES,
+};
+
+enum dfa_state {
+	STATE_REJECT = 0,
+	STATE_START,
+	STATE_NAME,	// in a name
+	STATE_ROOT,	// "/"
+	STATE_SEP,	// a '/' after a name
+	NB_STATES,
+};
+
+static const uint8_t dbus_name_dfa[NB_STATES][NB_CLASSES] = {
+	[STATE_START] = { [CLASS_NAME] = STATE_NAME },
+	[STATE_NAME] = { [CLASS_NAME] = STATE_NAME },
+};
+
+static const uint8_t dbus_path_dfa[NB_STATES][NB_CLASSES] = {
+	[STATE_START] = { [CLASS_SLASH] = STATE_ROOT },
+	[STATE_ROOT] = { [CLASS_NAME] = STATE_NAME },
+	[STATE_NAME] = { [CLASS_NAME] = STATE_NAME,
+		[CLASS_SLASH] = STATE_SEP },
+	[STATE_SEP] = { [CLASS_NAME] = STATE_NAME },
+};
+
+static enum char_class char_class(unsigned char c)
+{
+	if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+			(c >= '0' && c <= '9') || c == '_')
+		return CLASS_NAME;
+
+	if (c == '/')
+		return CLASS_SLASH;
+
+	return CLASS_OTHER;
+}
+
+static enum dfa_state run_dfa(const uint8_t dfa[NB_STATES][NB_CLASSES],
+		const char *str)
+{
+	enum dfa_state state = STATE_START;
+
+	while (*str && state != STATE_REJECT)
+		state = dfa[state][char_class(*str++)];
+
+	return state;
+}
+
+bool __validate_dbus_name(const char *str)
+{
+	return str && run_dfa(dbus_name_dfa, str) == STATE_NAME;
+}
+
+bool __validate_dbus_path(const char *str)
+{
+	enum dfa_state state;
+
+	if (!str)
+		return false;
+
+	state = run_dfa(dbus_path_dfa, str);
+
+	return state == STATE_ROOT || state == STATE_NAME;
+}
+
+/*
+ * A decimal number from 0 to max, without leading zeros. Returns the
+ * number of characters read, 0 if there isn't a valid number.
+ */
+static int parse_decimal(const char *str, int max)
+{
+	int i, val = 0;
+
+	for (i = 0; str[i] >= '0' && str[i] <= '9'; i++) {
+		if (i > 0 && val == 0)
+			return 0;
+
+		val = val * 10 + (str[i] - '0');
+
+		if (val > max)
+			return 0;
+	}
+
+	return i;
+}
+
+/*
+ * 4 decimal numbers from 0 to 255 separated by '.', "192.168.1.1"
+ */
+bool __validate_ipv4(const char *str)
+{
+	int i, len;
+
+	if (!str)
+		return false;
+
+	for (i = 0; i < 4; i++) {
+		if (i > 0 && *str++ != '.')
+			return false;
+
+		if (!(len = parse_decimal(str, 255)))
+			return false;
+
+		str += len;
+	}
+
+	return *str == '\0';
+}
+
+static bool is_hex(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+		(c >= 'A' && c <= 'F');
+}
+
+/*
+ * 8 groups of 1 to 4 hex digits separated by ':', "::" replaces one or more
+ * groups of zeros (once) and the last two groups can be written as an ipv4
+ * address: "2001:db8::1", "::ffff:192.168.1.1"
+ */
+bool __validate_ipv6(const char *str)
+{
+	const char *group = str;
+	int groups = 0, digits = 0;
+	bool compressed = false;
+
+	if (!str || !*str)
+		return false;
+
+	// a leading ':' must be the start of "::"
+	if (str[0] == ':' && str[1] != ':')
+		return false;
+
+	if (str[0] == ':')
+		str++;
+
+	for (; *str; str++) {
+		if (is_hex(*str)) {
+			if (++digits > 4)
+				return false;
+
+			continue;
+		}
+
+		if (*str == ':') {
+			// "::"
+			if (digits == 0) {
+				if (compressed)
+					return false;
+
+				compressed = true;
+				group = str + 1;
+				continue;
+			}
+
+			if (str[1] == '\0')
+				return false;
+
+			groups++;
+			digits = 0;
+			group = str + 1;
+			continue;
+		}
+
+		if (*str == '.') {
+			if (groups > 6 || !__validate_ipv4(group))
+				return false;
+
+			groups += 2;
+			digits = 0;
+			break;
+		}
+
+		return false;
+	}
+
+	if (digits)
+		groups++;
+
+	if (compressed)
+		return groups < 8;
+
+	return groups == 8;
+}
+
+bool __validate_prefix_length(const char *str)
+{
+	int len;
+
+	if (!str)
+		return false;
+
+	len = parse_decimal(str, 128);
+
+	return len && str[len] == '\0';
+}
+
+static const struct named_validator named_validators[] = {
+	{ "dbus_name", __validate_dbus_name, false },
+	{ "dbus_path", __validate_dbus_path, false },
+	{ "ipv4", __validate_ipv4, false },
+	{ "ipv6", __validate_ipv6, false },
+	{ "prefix_length", __validate_prefix_length, true },
+	{ NULL, }, // this is a sentinel
+};
+
+/*
+ * The validator named by trusted ("@ipv4"), NULL if trusted is a regex.
+ */
+const struct named_validator* __validator_lookup(const char *trusted)
+{
+	int i;
+
+	if (!trusted || trusted[0] != VALIDATOR_PREFIX)
+		return NULL;
+
+	for (i = 0; named_validators[i].name; i++)
+		if (strcmp(named_validators[i].name, trusted + 1) == 0)
+			return &named_validators[i];
+
+	return NULL;
+}
+
+bool __validator_match_json(const struct named_validator *validator,
+		struct json_object *jobj)
+{
+	switch (json_object_get_type(jobj)) {
+
+		case json_type_string:
+			return validator->validate(json_object_get_string(jobj));
+
+		case json_type_int:
+			return validator->accepts_int &&
+				validator->validate(json_object_get_string(jobj));
+
+		default:
+			return false;
+	}
+}
@@ -0,0 +1,64 @@
+/*
+ *  connman-json-client
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_VALIDATORS_H
+#define __CONNMAN_VALIDATORS_H
+
+#include <stdbool.h>
+#include <json/json.h>
+
+/*
+ * In a trusted json, a string starting with this character names a
+ * validator instead of being a regex: "@ipv4", "@dbus_path"...
+ */
+#define VALIDATOR_PREFIX '@'
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct named_validator {
+	const char *name;
+	bool (*validate)(const char *str);
+	bool accepts_int;	// a json int is checked as its decimal string
+};
+
+/* [A-Za-z0-9_]+, an element of a dbus object path */
+bool __validate_dbus_name(const char *str);
+
+/* "/" or ("/" dbus_name)+ */
+bool __validate_dbus_path(const char *str);
+
+bool __validate_ipv4(const char *str);
+
+bool __validate_ipv6(const char *str);
+
+/* 0 to 128 */
+bool __validate_prefix_length(const char *str);
+
+const struct named_validator* __validator_lookup(const char *trusted);
+
+bool __validator_match_json(const struct named_validator *validator,
+		struct json_object *jobj);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif